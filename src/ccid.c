@@ -38,19 +38,6 @@
 #include <CoreFoundation/CoreFoundation.h>
 #endif
 
-/*****************************************************************************
- *
- *					set_read_timeout
- *
- ****************************************************************************/
-int set_read_timeout(CcidDesc * ccid_reader, int new_timeout)
-{
-	int old_timeout = ccid_reader->device.ccid.readTimeout;
-	if (new_timeout > 0)
-		ccid_reader->device.ccid.readTimeout = new_timeout;
-	return old_timeout;
-} /* set_read_timeout */
-
 /*****************************************************************************
  *
  *					ccid_open_hack_pre
@@ -156,10 +143,12 @@ int ccid_open_hack_pre(CcidDesc * ccid_reader)
 	{
 		unsigned char tmp[MAX_ATR_SIZE];
 		unsigned int n = sizeof(tmp);
+		int voltage = VOLTAGE_AUTO;
 
 		DEBUG_COMM("ICCD type A");
 		(void)CmdPowerOff(ccid_reader);
-		(void)CmdPowerOn(ccid_reader, &n, tmp, VOLTAGE_AUTO);
+		(void)CmdPowerOn(ccid_reader, &n, tmp, &voltage, true,
+			ccid_descriptor->readTimeout);
 		(void)CmdPowerOff(ccid_reader);
 	}
 
@@ -168,6 +157,7 @@ int ccid_open_hack_pre(CcidDesc * ccid_reader)
 	{
 		unsigned char tmp[MAX_ATR_SIZE];
 		unsigned int n = sizeof(tmp);
+		int voltage = VOLTAGE_AUTO;
 
 		DEBUG_COMM("ICCD type B");
 		if (CCID_CLASS_SHORT_APDU ==
@@ -179,7 +169,8 @@ int ccid_open_hack_pre(CcidDesc * ccid_reader)
 		}
 
 		(void)CmdPowerOff(ccid_reader);
-		(void)CmdPowerOn(ccid_reader, &n, tmp, VOLTAGE_AUTO);
+		(void)CmdPowerOn(ccid_reader, &n, tmp, &voltage, true,
+			ccid_descriptor->readTimeout);
 		(void)CmdPowerOff(ccid_reader);
 	}
 
@@ -188,7 +188,6 @@
 #define VOLTAGE_3V 2
 #define VOLTAGE_1_8V 3
 
-int set_read_timeout(CcidDesc * ccid_reader, int new_timeout);
 int ccid_open_hack_pre(CcidDesc * ccid_reader);
 int ccid_open_hack_post(CcidDesc * ccid_reader);
 void ccid_error(int log_level, int error, const char *file, int line,
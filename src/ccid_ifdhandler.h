@@ -21,6 +21,13 @@
 #define _ccid_ifd_handler_h_
 
 #define IOCTL_SMARTCARD_VENDOR_IFD_EXCHANGE	SCARD_CTL_CODE(1)
+#define IOCTL_SMARTCARD_VENDOR_APDU_SCRIPT	SCARD_CTL_CODE(2)
+#define IOCTL_SMARTCARD_VENDOR_ICCD_WAIT_STATS	SCARD_CTL_CODE(3)
+
+/* TLV tags used by IOCTL_SMARTCARD_VENDOR_APDU_SCRIPT */
+#define APDU_SCRIPT_TAG_COMMAND 0x01
+#define APDU_SCRIPT_TAG_EXPECTED_STATUS 0x02
+#define APDU_SCRIPT_TAG_RESPONSE 0x81
 
 #define CLASS2_IOCTL_MAGIC 0x330000
 #define IOCTL_FEATURE_VERIFY_PIN_DIRECT \
@@ -37,7 +44,10 @@
 #define DRIVER_OPTION_CCID_EXCHANGE_AUTHORIZED 1
 #define DRIVER_OPTION_GEMPC_TWIN_KEY_APDU 2
 #define DRIVER_OPTION_USE_BOGUS_FIRMWARE 4
+#define DRIVER_OPTION_USB_HOTPLUG 8
 #define DRIVER_OPTION_DISABLE_PIN_RETRIES (1 << 6)
+#define DRIVER_OPTION_T0_GET_RESPONSE (1 << 7)
+#define DRIVER_OPTION_MAX_CLOCK_AND_DATA_RATE (1 << 8)
 
 extern int DriverOptions;
 
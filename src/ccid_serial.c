@@ -104,10 +104,10 @@ extern CcidDesc **CcidSlots;
 
 /* unexported functions */
 static int ReadChunk(CcidDesc * ccid_reader, unsigned char *buffer,
-	int buffer_length, int min_length);
+	int buffer_length, int min_length, const struct timespec *deadline);
 
 static int get_bytes(CcidDesc * ccid_reader, /*@out@*/ unsigned char *buffer,
-	int length);
+	int length, const struct timespec *deadline);
 
 
 /*****************************************************************************
@@ -118,15 +118,34 @@ static int get_bytes(CcidDesc * ccid_reader, /*@out@*/ unsigned char *buffer,
 status_t WriteSerial(CcidDesc * ccid_reader, unsigned int length,
 	unsigned char *buffer)
 {
-	unsigned int i;
+	struct iovec iov = { buffer, length };
+
+	return WritevSerial(ccid_reader, &iov, 1);
+} /* WriteSerial */
+
+
+/*****************************************************************************
+ *
+ *				WritevSerial: Send bytes to the card reader
+ *
+ *****************************************************************************/
+status_t WritevSerial(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt)
+{
+	unsigned int i, length = 0;
 	unsigned char lrc;
-	unsigned char low_level_buffer[GEMPCTWIN_MAXBUF];
+	unsigned char sync_ack[] = { 0x03, 0x06 };	/* SYNC, ACK */
+	struct iovec low_level_iov[iovcnt + 2];
+	ssize_t written;
 
 	char debug_header[] = "-> lun: 12345678, ";
 
 	(void)snprintf(debug_header, sizeof(debug_header), "-> lun: %X, ",
 		ccid_reader->lun);
 
+	for (int v=0; v<iovcnt; v++)
+		length += iov[v].iov_len;
+
 	if (length > GEMPCTWIN_MAXBUF-3)
 	{
 		DEBUG_CRITICAL3("command too long: %d for max %d",
@@ -135,29 +154,36 @@ status_t WriteSerial(CcidDesc * ccid_reader, unsigned int length,
 	}
 
 	/* header */
-	low_level_buffer[0] = 0x03;	/* SYNC */
-	low_level_buffer[1] = 0x06;	/* ACK */
+	low_level_iov[0].iov_base = sync_ack;
+	low_level_iov[0].iov_len = sizeof sync_ack;
+	lrc = sync_ack[0] ^ sync_ack[1];
+	DEBUG_XXD(debug_header, sync_ack, sizeof sync_ack);
 
-	/* CCID command */
-	memcpy(low_level_buffer+2, buffer, length);
+	/* CCID command, written without copy */
+	for (int v=0; v<iovcnt; v++)
+	{
+		const unsigned char *data = iov[v].iov_base;
 
-	/* checksum */
-	lrc = 0;
-	for(i=0; i<length+2; i++)
-		lrc ^= low_level_buffer[i];
-	low_level_buffer[length+2] = lrc;
+		for (i=0; i<iov[v].iov_len; i++)
+			lrc ^= data[i];
+		low_level_iov[v+1] = iov[v];
+		DEBUG_XXD(debug_header, data, iov[v].iov_len);
+	}
 
-	DEBUG_XXD(debug_header, low_level_buffer, length+3);
+	/* checksum */
+	low_level_iov[iovcnt+1].iov_base = &lrc;
+	low_level_iov[iovcnt+1].iov_len = 1;
+	DEBUG_XXD(debug_header, &lrc, 1);
 
-	if (write(ccid_reader->device.fd, low_level_buffer,
-		length+3) != length+3)
+	written = writev(ccid_reader->device.fd, low_level_iov, iovcnt + 2);
+	if (written != (ssize_t)(length+3))
 	{
 		DEBUG_CRITICAL2("write error: %s", strerror(errno));
 		return STATUS_UNSUCCESSFUL;
 	}
 
 	return STATUS_SUCCESS;
-} /* WriteSerial */
+} /* WritevSerial */
 
 
 /*****************************************************************************
@@ -166,23 +192,53 @@ status_t WriteSerial(CcidDesc * ccid_reader, unsigned int length,
  *
  *****************************************************************************/
 status_t ReadSerial(CcidDesc * ccid_reader,
-	unsigned int *length, unsigned char *buffer, int bSeq)
+	unsigned int *length, unsigned char *buffer, int bSeq,
+	unsigned int timeout)
 {
+	struct iovec iov = { buffer, *length };
+	status_t ret;
+
+	ret = ReadvSerial(ccid_reader, &iov, 1, length, bSeq, timeout);
+	if ((STATUS_SUCCESS == ret) && (*length > iov.iov_len))
+	{
+		DEBUG_CRITICAL2("Wrong value for frame size: %d", *length);
+		return STATUS_COMM_ERROR;
+	}
+
+	return ret;
+} /* ReadSerial */
+
+
+/*****************************************************************************
+ *
+ *			ReadvSerial: Receive a frame in several buffers
+ *
+ *****************************************************************************/
+status_t ReadvSerial(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt, unsigned int *length, int bSeq, unsigned int timeout)
+{
+	struct timespec deadline;
 	unsigned char c;
+	unsigned char header[5];
+	unsigned char lrc;
 	int rv;
 	int echo;
 	int to_read;
+	int done;
 	int i;
 
 	/* ignore bSeq */
 	(void)bSeq;
 
+	/* the timeout applies to the complete frame, not to each chunk */
+	deadline_init(&deadline, timeout);
+
 	/* we get the echo first */
 	echo = ccid_reader->device.echo;
 
 start:
 	DEBUG_COMM("start");
-	if ((rv = get_bytes(ccid_reader, &c, 1)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, &c, 1, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	if (c == RDR_to_PC_NotifySlotChange)
@@ -202,7 +258,7 @@ start:
 
 slot_change:
 	DEBUG_COMM("slot change");
-	if ((rv = get_bytes(ccid_reader, &c, 1)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, &c, 1, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	if (c == CARD_ABSENT)
@@ -222,7 +278,7 @@ slot_change:
 
 sync:
 	DEBUG_COMM("sync");
-	if ((rv = get_bytes(ccid_reader, &c, 1)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, &c, 1, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	if (c == CTRL_ACK)
@@ -236,7 +292,7 @@ sync:
 
 nak:
 	DEBUG_COMM("nak");
-	if ((rv = get_bytes(ccid_reader, &c, 1)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, &c, 1, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	if (c != (SYNC ^ CTRL_NAK))
@@ -253,32 +309,81 @@ nak:
 ack:
 	DEBUG_COMM("ack");
 	/* normal CCID frame */
-	if ((rv = get_bytes(ccid_reader, buffer, 5)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, header, sizeof header, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	/* total frame size */
-	to_read = CCID_RESPONSE_HEADER_SIZE + dw2i(buffer, 1);
+	to_read = CCID_RESPONSE_HEADER_SIZE + dw2i(header, 1);
 
-	if ((to_read < CCID_RESPONSE_HEADER_SIZE) || (to_read > (int)*length))
+	if ((to_read < CCID_RESPONSE_HEADER_SIZE)
+		|| (to_read > CCID_RESPONSE_HEADER_SIZE + CMD_BUF_SIZE))
 	{
 		DEBUG_CRITICAL2("Wrong value for frame size: %d", to_read);
 		return STATUS_COMM_ERROR;
 	}
 
 	DEBUG_COMM2("frame size: %d", to_read);
-	if ((rv = get_bytes(ccid_reader, buffer+5, to_read-5)) != STATUS_SUCCESS)
-		return rv;
+	lrc = 0;
+	for (i=0; i<(int)sizeof header; i++)
+		lrc ^= header[i];
+
+	/* the frame is received directly in the caller buffers */
+	done = 0;
+	for (int v=0; (v<iovcnt) && (done < to_read); v++)
+	{
+		unsigned char *data = iov[v].iov_base;
+		int n = to_read - done;
+		int from_header = 0;
+
+		if ((int)iov[v].iov_len < n)
+			n = iov[v].iov_len;
 
-	DEBUG_XXD("frame: ", buffer, to_read);
+		if (done < (int)sizeof header)
+		{
+			from_header = (int)sizeof header - done;
+			if (from_header > n)
+				from_header = n;
+			memcpy(data, header + done, from_header);
+		}
+
+		if ((rv = get_bytes(ccid_reader, data + from_header,
+			n - from_header, &deadline)) != STATUS_SUCCESS)
+			return rv;
+
+		for (i=from_header; i<n; i++)
+			lrc ^= data[i];
+
+		DEBUG_XXD("frame: ", data, n);
+		done += n;
+	}
+
+	/* drop the end of a frame too long for the caller buffers */
+	if (done < (int)sizeof header)
+		done = sizeof header;
+	while (done < to_read)
+	{
+		unsigned char dropped[64];
+		int n = to_read - done;
+
+		if (n > (int)sizeof dropped)
+			n = sizeof dropped;
+
+		if ((rv = get_bytes(ccid_reader, dropped, n, &deadline)) != STATUS_SUCCESS)
+			return rv;
+
+		for (i=0; i<n; i++)
+			lrc ^= dropped[i];
+
+		done += n;
+	}
 
 	/* lrc */
 	DEBUG_COMM("lrc");
-	if ((rv = get_bytes(ccid_reader, &c, 1)) != STATUS_SUCCESS)
+	if ((rv = get_bytes(ccid_reader, &c, 1, &deadline)) != STATUS_SUCCESS)
 		return rv;
 
 	DEBUG_COMM2("lrc: 0x%02X", c);
-	for (i=0; i<to_read; i++)
-		c ^= buffer[i];
+	c ^= lrc;
 
 	if (c != (SYNC ^ CTRL_ACK))
 		DEBUG_CRITICAL2("Wrong LRC: 0x%02X", c);
@@ -293,7 +398,7 @@ ack:
 	*length = to_read;
 
 	return STATUS_SUCCESS;
-} /* ReadSerial */
+} /* ReadvSerial */
 
 
 /*****************************************************************************
@@ -301,7 +406,8 @@ ack:
  *				get_bytes: get n bytes
  *
  *****************************************************************************/
-int get_bytes(CcidDesc * ccid_reader, unsigned char *buffer, int length)
+static int get_bytes(CcidDesc * ccid_reader, unsigned char *buffer, int length,
+	const struct timespec *deadline)
 {
 	int offset = ccid_reader->device.buffer_offset;
 	int offset_last = ccid_reader->device.buffer_offset_last;
@@ -332,7 +438,7 @@ int get_bytes(CcidDesc * ccid_reader, unsigned char *buffer, int length)
 		/* get fresh data */
 		DEBUG_COMM2("get more data: %d", length - present);
 		rv = ReadChunk(ccid_reader, ccid_reader->device.buffer,
-			sizeof(ccid_reader->device.buffer), length - present);
+			sizeof(ccid_reader->device.buffer), length - present, deadline);
 		if (rv < 0)
 		{
 			ccid_reader->device.buffer_offset = 0;
@@ -360,7 +466,7 @@ int get_bytes(CcidDesc * ccid_reader, unsigned char *buffer, int length)
  *
  *****************************************************************************/
 static int ReadChunk(CcidDesc * ccid_reader, unsigned char *buffer,
-	int buffer_length, int min_length)
+	int buffer_length, int min_length, const struct timespec *deadline)
 {
 	int fd = ccid_reader->device.fd;
 # ifndef S_SPLINT_S
@@ -377,11 +483,13 @@ static int ReadChunk(CcidDesc * ccid_reader, unsigned char *buffer,
 	already_read = 0;
 	while (already_read < min_length)
 	{
+		unsigned int remaining = deadline_remaining(deadline);
+
 		/* use select() to, eventually, timeout */
 		FD_ZERO(&fdset);
 		FD_SET(fd, &fdset);
-		t.tv_sec = ccid_reader->device.ccid.readTimeout / 1000;
-		t.tv_usec = (ccid_reader->device.ccid.readTimeout - t.tv_sec*1000)*1000;
+		t.tv_sec = remaining / 1000;
+		t.tv_usec = (remaining - t.tv_sec*1000)*1000;
 
 		i = select(fd+1, &fdset, NULL, NULL, &t);
 		if (i == -1)
@@ -392,7 +500,7 @@ static int ReadChunk(CcidDesc * ccid_reader, unsigned char *buffer,
 		else
 			if (i == 0)
 			{
-				DEBUG_COMM2("Timeout! (%d ms)", ccid_reader->device.ccid.readTimeout);
+				DEBUG_COMM("Timeout!");
 				return -1;
 			}
 
@@ -641,6 +749,10 @@ static status_t set_ccid_descriptor(CcidDesc * ccid_reader,
 
 	}
 
+	/* no clock frequency change */
+	ccid_reader->device.ccid.dwMaximumClock = ccid_reader->device.ccid.dwDefaultClock;
+	ccid_reader->device.ccid.arrayOfSupportedClocks = NULL;
+
 end:
 	/* memorise the current reader_index so we can detect
 	 * a new OpenSerialByName on a multi slot reader */
@@ -756,7 +868,6 @@ status_t OpenSerialByName(CcidDesc * ccid_reader, char *dev_name)
 	if (GEMCORESIMPRO2 == readerID)
 	{
 		unsigned char pcbuffer[SIZE_GET_SLOT_STATUS];
-		unsigned int old_timeout;
 		RESPONSECODE r;
 
 		/* Unless we resume from a stand-by condition, GemCoreSIMPro2
@@ -775,13 +886,7 @@ status_t OpenSerialByName(CcidDesc * ccid_reader, char *dev_name)
 
 		/* Test current speed issuing a CmdGetSlotStatus with a very
 		 * short time out of 1 seconds */
-		old_timeout = ccid_reader->device.ccid.readTimeout;
-
-		ccid_reader->device.ccid.readTimeout = 1*1000;
-		r = CmdGetSlotStatus(ccid_reader, pcbuffer);
-
-		/* Restore default time out value */
-		ccid_reader->device.ccid.readTimeout = old_timeout;
+		r = CmdGetSlotStatus(ccid_reader, pcbuffer, 1*1000);
 
 		if (IFD_SUCCESS == r)
 		{
@@ -27,8 +27,15 @@ status_t OpenSerialByName(CcidDesc * ccid_reader, char *dev_name);
 status_t WriteSerial(CcidDesc * ccid_reader, unsigned int length,
 	unsigned char *Buffer);
 
+#include <sys/uio.h>
+status_t WritevSerial(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt);
+
 status_t ReadSerial(CcidDesc * ccid_reader, unsigned int *length,
-	unsigned char *Buffer, int bSeq);
+	unsigned char *Buffer, int bSeq, unsigned int timeout);
+
+status_t ReadvSerial(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt, unsigned int *length, int bSeq, unsigned int timeout);
 
 status_t CloseSerial(CcidDesc * ccid_reader);
 
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 # ifdef S_SPLINT_S
 # include <sys/types.h>
 # endif
@@ -47,6 +48,25 @@
  * we don't have to wait a long time since the card was doing nothing */
 #define USB_WRITE_TIMEOUT (5 * 1000)	/* 5 seconds timeout */
 
+/* size of the buffer used to receive a response in advance
+ * (see WriteUSB()) and by Multi_ReadProc() */
+#define BULK_IN_BUFFER_SIZE (10 + MAX_BUFFER_SIZE_EXTENDED)
+
+/* offsets in a CCID frame */
+#define BSLOT_OFFSET 5
+#define BSEQ_OFFSET 6
+#define STATUS_OFFSET 7
+
+/* size of a multislot frame buffer: a multiple of the max packet size
+ * so that a too long frame is truncated instead of overflowing */
+#define FRAME_SIZE(length) (((length) + 511) & ~511)
+
+/* states of struct slotPresence */
+#define PRESENCE_UNTRACKED 0	/* the interrupt endpoint is not polled */
+#define PRESENCE_UNKNOWN 1	/* a PC_to_RDR_GetSlotStatus is needed */
+#define PRESENCE_ABSENT 2
+#define PRESENCE_PRESENT 3
+
 /*
  * Proprietary USB Class (0xFF) are (or are not) accepted
  * A proprietary class is used for devices released before the final CCID
@@ -62,6 +82,28 @@
 /* #define ctx NULL */
 static libusb_context *ctx = NULL;
 
+/* thread handling the libusb events for all the readers */
+static pthread_t event_thread;
+static int event_thread_exit;
+
+#ifdef HAVE_LIBUSB_HOTPLUG
+/* USB devices tracked using the libusb hotplug events
+ * (see DRIVER_OPTION_USB_HOTPLUG) */
+struct hotplugDevice
+{
+	libusb_device *dev;
+	uint8_t bus_number;
+	uint8_t device_address;
+	struct hotplugDevice *next;
+};
+
+static pthread_mutex_t hotplug_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hotplugDevice *hotplug_devices = NULL;
+static int hotplug_nb_devices = 0;
+static bool hotplug_registered = false;
+static libusb_hotplug_callback_handle hotplug_handle;
+#endif
+
 /* The _usbDevice structure must be defined before including ccid_usb.h */
 #include "ccid_usb.h"
 
@@ -70,12 +112,39 @@ static int Multi_InterruptRead(CcidDesc * ccid_reader, int timeout /* in ms */);
 static void Multi_InterruptStop(CcidDesc * ccid_reader);
 static struct usbDevice_MultiSlot_Extension *Multi_CreateFirstSlot(CcidDesc * ccid_reader);
 static void Multi_PollingTerminate(struct usbDevice_MultiSlot_Extension *msExt);
+static void Multi_SignalSlots(struct usbDevice_MultiSlot_Extension *msExt,
+	int status, /*@null@*/ const unsigned char *notify_slot_change,
+	int length);
+static int Multi_AcquireSlot(struct usbDevice_MultiSlot_Extension *msExt,
+	int slot, unsigned char bSeq, unsigned int timeout);
+static void Multi_ReleaseSlot(struct usbDevice_MultiSlot_Extension *msExt,
+	int slot);
+static struct multiSlotFrame *Multi_GetFrame(
+	struct usbDevice_MultiSlot_Extension *msExt, int size);
+static void Multi_PutFrame(struct usbDevice_MultiSlot_Extension *msExt,
+	struct multiSlotFrame *frame);
 
 static int get_end_points(const struct libusb_interface *usb_interface,
 	_usbDevice *usbdevice);
 static bool ccid_check_firmware(struct libusb_device_descriptor *desc);
-static unsigned int *get_data_rates(CcidDesc * ccid_reader,
-	const unsigned char bNumDataRatesSupported);
+static unsigned int *get_supported_values(CcidDesc * ccid_reader,
+	unsigned char bRequest, const unsigned char bNumSupported);
+
+/* asynchronous transfers */
+static struct usbTransfer *alloc_usb_transfer(libusb_device_handle *dev_handle,
+	int length);
+static void free_usb_transfer(libusb_device_handle *dev_handle,
+	struct usbTransfer *usb_transfer);
+static void bulk_transfer_cb(struct libusb_transfer *transfer);
+static int submit_bulk_in(libusb_device_handle *dev_handle,
+	_usbDevice *usb_device, unsigned char *buffer, int length);
+static bool iov_contiguous(const struct iovec *iov, int iovcnt);
+static int wait_transfer(struct usbTransfer *usb_transfer,
+	unsigned int timeout);
+static void cancel_transfer(struct usbTransfer *usb_transfer);
+static void abort_transfer(struct usbTransfer *usb_transfer);
+static void update_presence(struct slotPresence *presence,
+	const unsigned char *notify_slot_change, int length, int slot);
 
 extern CcidDesc **CcidSlots;
 extern int ccid_driver_max_readers;
@@ -120,6 +189,365 @@ static struct _bogus_firmware Bogus_firmwares[] = {
 /* data rates supported by the secondary slots on the GemCore Pos Pro & SIM Pro */
 static unsigned int SerialCustomDataRates[] = { GEMPLUS_CUSTOM_DATA_RATES, 0 };
 
+#ifdef USE_COMPILED_READER_DB
+/* supported readers generated from readers/supported_readers.txt */
+struct readerDbEntry
+{
+	unsigned short vendorID;
+	unsigned short productID;
+	const char *friendlyName;
+};
+
+#include "reader_db.h"
+
+/*****************************************************************************
+ *
+ *					find_reader_db
+ *
+ ****************************************************************************/
+static const struct readerDbEntry *find_reader_db(unsigned int vendorID,
+	unsigned int productID, /*@null@*/ const char *device)
+{
+	unsigned int key = (vendorID << 16) + productID;
+	size_t low = 0, high = sizeof reader_db / sizeof reader_db[0];
+
+	/* binary search of the first entry for vendorID/productID */
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		const struct readerDbEntry *entry = &reader_db[middle];
+
+		if (((unsigned int)entry->vendorID << 16) + entry->productID < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (; low < sizeof reader_db / sizeof reader_db[0]; low++)
+	{
+		const struct readerDbEntry *entry = &reader_db[low];
+
+		if ((entry->vendorID != vendorID) || (entry->productID != productID))
+			break;
+
+#ifdef __APPLE__
+		/* Leopard puts the friendlyname in the device argument */
+		if (device && strcmp(device, entry->friendlyName))
+			continue;
+#else
+		(void)device;
+#endif
+
+		return entry;
+	}
+
+	return NULL;
+} /* find_reader_db */
+
+#else
+
+/* index of the supported readers using the vendor/product IDs as key */
+#define ALIAS_INDEX_BITS 10
+#define ALIAS_INDEX_SIZE (1 << ALIAS_INDEX_BITS)
+
+struct readerAlias
+{
+	unsigned int vendorID;
+	unsigned int productID;
+	int alias;	/* position in the Info.plist lists */
+	struct readerAlias *next;
+};
+
+static struct readerAlias *alias_index[ALIAS_INDEX_SIZE];
+static struct readerAlias *alias_entries = NULL;
+/* Info.plist generation used to build the index */
+static unsigned int alias_generation = 0;
+
+/*****************************************************************************
+ *
+ *					alias_hash
+ *
+ ****************************************************************************/
+static unsigned int alias_hash(unsigned int vendorID, unsigned int productID)
+{
+	/* multiplicative hashing */
+	uint32_t key = (vendorID << 16) + productID;
+
+	return (uint32_t)(key * 2654435761u) >> (32 - ALIAS_INDEX_BITS);
+} /* alias_hash */
+
+/*****************************************************************************
+ *
+ *					build_alias_index
+ *
+ ****************************************************************************/
+static bool build_alias_index(list_t *ifdVendorID, list_t *ifdProductID,
+	unsigned int generation)
+{
+	int nb_aliases = list_size(ifdVendorID);
+
+	/* already done for this version of Info.plist */
+	if (alias_entries && (alias_generation == generation))
+		return true;
+
+	free(alias_entries);
+	alias_generation = 0;
+
+	alias_entries = calloc(nb_aliases, sizeof(struct readerAlias));
+	if (NULL == alias_entries)
+	{
+		DEBUG_CRITICAL("malloc failed");
+		return false;
+	}
+
+	memset(alias_index, 0, sizeof alias_index);
+
+	/* insert in reverse order so that the first alias of a vendor/product
+	 * pair is found first */
+	for (int alias=nb_aliases-1; alias>=0; alias--)
+	{
+		struct readerAlias *entry = &alias_entries[alias];
+		unsigned int h;
+
+		entry->vendorID = strtoul(list_get_at(ifdVendorID, alias), NULL, 0);
+		entry->productID = strtoul(list_get_at(ifdProductID, alias), NULL, 0);
+		entry->alias = alias;
+
+		h = alias_hash(entry->vendorID, entry->productID);
+		entry->next = alias_index[h];
+		alias_index[h] = entry;
+	}
+
+	alias_generation = generation;
+
+	DEBUG_INFO2("%d supported readers indexed", nb_aliases);
+
+	return true;
+} /* build_alias_index */
+
+/*****************************************************************************
+ *
+ *					find_reader_alias
+ *
+ ****************************************************************************/
+static int find_reader_alias(unsigned int vendorID, unsigned int productID,
+	/*@null@*/ const char *device, list_t *ifdFriendlyName)
+{
+	struct readerAlias *entry;
+
+	for (entry = alias_index[alias_hash(vendorID, productID)]; entry;
+		entry = entry->next)
+	{
+		if ((entry->vendorID != vendorID) || (entry->productID != productID))
+			continue;
+
+#ifdef __APPLE__
+		/* Leopard puts the friendlyname in the device argument */
+		if (device && strcmp(device, list_get_at(ifdFriendlyName, entry->alias)))
+			continue;
+#else
+		(void)device;
+		(void)ifdFriendlyName;
+#endif
+
+		return entry->alias;
+	}
+
+	return -1;
+} /* find_reader_alias */
+#endif
+
+#ifdef HAVE_LIBUSB_HOTPLUG
+/*****************************************************************************
+ *
+ *					hotplug_cb
+ *
+ ****************************************************************************/
+static int hotplug_cb(libusb_context *context, libusb_device *dev,
+	libusb_hotplug_event event, void *user_data)
+{
+	uint8_t bus_number = libusb_get_bus_number(dev);
+	uint8_t device_address = libusb_get_device_address(dev);
+
+	(void)context;
+	(void)user_data;
+
+	pthread_mutex_lock(&hotplug_mutex);
+	if (LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED == event)
+	{
+		struct hotplugDevice *hotplug_device;
+
+		hotplug_device = malloc(sizeof(*hotplug_device));
+		if (NULL == hotplug_device)
+			DEBUG_CRITICAL("malloc failed");
+		else
+		{
+			DEBUG_COMM3("USB device arrived: %d/%d", bus_number,
+				device_address);
+
+			hotplug_device->dev = libusb_ref_device(dev);
+			hotplug_device->bus_number = bus_number;
+			hotplug_device->device_address = device_address;
+			hotplug_device->next = hotplug_devices;
+			hotplug_devices = hotplug_device;
+			hotplug_nb_devices++;
+		}
+	}
+	else
+	{
+		struct hotplugDevice **previous = &hotplug_devices;
+
+		DEBUG_COMM3("USB device left: %d/%d", bus_number, device_address);
+
+		while (*previous)
+		{
+			struct hotplugDevice *hotplug_device = *previous;
+
+			if (hotplug_device->dev == dev)
+			{
+				*previous = hotplug_device->next;
+				libusb_unref_device(hotplug_device->dev);
+				free(hotplug_device);
+				hotplug_nb_devices--;
+				break;
+			}
+			previous = &hotplug_device->next;
+		}
+
+		/* do not wait for a transfer to fail */
+		for (int i=0; i<ccid_driver_max_readers; i++)
+		{
+			_usbDevice *usb_device = &CcidSlots[i]->device;
+
+			if (usb_device->dev_handle
+				&& (usb_device->bus_number == bus_number)
+				&& (usb_device->device_address == device_address))
+			{
+				DEBUG_COMM2("Disconnect reader: %d", i);
+				usb_device->disconnected = true;
+			}
+		}
+	}
+	pthread_mutex_unlock(&hotplug_mutex);
+
+	/* keep the callback registered */
+	return 0;
+} /* hotplug_cb */
+
+/*****************************************************************************
+ *
+ *					hotplug_register
+ *
+ ****************************************************************************/
+static void hotplug_register(void)
+{
+	int rv;
+
+	if (! libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+	{
+		DEBUG_INFO1("libusb hotplug not supported");
+		return;
+	}
+
+	/* the already connected devices are reported during the registration */
+	rv = libusb_hotplug_register_callback(ctx,
+		LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+		LIBUSB_HOTPLUG_ENUMERATE, LIBUSB_HOTPLUG_MATCH_ANY,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, hotplug_cb, NULL,
+		&hotplug_handle);
+	if (rv != LIBUSB_SUCCESS)
+	{
+		DEBUG_CRITICAL2("libusb_hotplug_register_callback failed: %s",
+			libusb_error_name(rv));
+		return;
+	}
+
+	hotplug_registered = true;
+} /* hotplug_register */
+
+/*****************************************************************************
+ *
+ *					hotplug_deregister
+ *
+ ****************************************************************************/
+static void hotplug_deregister(void)
+{
+	if (! hotplug_registered)
+		return;
+
+	libusb_hotplug_deregister_callback(ctx, hotplug_handle);
+	hotplug_registered = false;
+
+	pthread_mutex_lock(&hotplug_mutex);
+	while (hotplug_devices)
+	{
+		struct hotplugDevice *hotplug_device = hotplug_devices;
+
+		hotplug_devices = hotplug_device->next;
+		libusb_unref_device(hotplug_device->dev);
+		free(hotplug_device);
+	}
+	hotplug_nb_devices = 0;
+	pthread_mutex_unlock(&hotplug_mutex);
+} /* hotplug_deregister */
+#endif
+
+/*****************************************************************************
+ *
+ *					get_device_list
+ *
+ ****************************************************************************/
+static ssize_t get_device_list(libusb_device ***list, bool scan_bus)
+{
+#ifdef HAVE_LIBUSB_HOTPLUG
+	if (hotplug_registered && ! scan_bus)
+	{
+		struct hotplugDevice *hotplug_device;
+		libusb_device **devs;
+		ssize_t cnt = 0;
+
+		/* no need to scan the USB bus */
+		pthread_mutex_lock(&hotplug_mutex);
+		devs = calloc(hotplug_nb_devices + 1, sizeof(libusb_device *));
+		if (NULL == devs)
+		{
+			pthread_mutex_unlock(&hotplug_mutex);
+			return LIBUSB_ERROR_NO_MEM;
+		}
+
+		for (hotplug_device = hotplug_devices; hotplug_device;
+			hotplug_device = hotplug_device->next)
+			devs[cnt++] = libusb_ref_device(hotplug_device->dev);
+		pthread_mutex_unlock(&hotplug_mutex);
+
+		*list = devs;
+		return cnt;
+	}
+#endif
+
+	return libusb_get_device_list(ctx, list);
+} /* get_device_list */
+
+/*****************************************************************************
+ *
+ *					free_device_list
+ *
+ ****************************************************************************/
+static void free_device_list(libusb_device **list, bool scan_bus)
+{
+#ifdef HAVE_LIBUSB_HOTPLUG
+	if (hotplug_registered && ! scan_bus)
+	{
+		for (int i=0; list[i]; i++)
+			libusb_unref_device(list[i]);
+		free(list);
+		return;
+	}
+#endif
+
+	libusb_free_device_list(list, 1);
+} /* free_device_list */
+
 /*****************************************************************************
  *
  *					close_libusb_if_needed
@@ -141,12 +569,64 @@ static void close_libusb_if_needed(void)
 
 	if (to_exit)
 	{
+		/* stop the event thread */
+		event_thread_exit = 1;
+#ifdef HAVE_LIBUSB_INTERRUPT_EVENT_HANDLER
+		libusb_interrupt_event_handler(ctx);
+#endif
+		pthread_join(event_thread, NULL);
+
+#ifdef HAVE_LIBUSB_HOTPLUG
+		hotplug_deregister();
+#endif
+
 		DEBUG_INFO1("libusb_exit");
 		libusb_exit(ctx);
 		ctx = NULL;
 	}
 } /* close_libusb_if_needed */
 
+/*****************************************************************************
+ *
+ *					EventProc
+ *
+ ****************************************************************************/
+static void *EventProc(void *arg)
+{
+	(void)arg;
+
+	DEBUG_INFO1("Event thread starting");
+
+	/* all the asynchronous transfers complete in this thread and the
+	 * callback wakes up the thread waiting for the transfer */
+	while (! event_thread_exit)
+	{
+		int rv;
+
+#ifdef HAVE_LIBUSB_INTERRUPT_EVENT_HANDLER
+		rv = libusb_handle_events_completed(ctx, &event_thread_exit);
+#else
+		/* no way to wake us up: check event_thread_exit every second */
+		struct timeval tv = { 1, 0 };
+
+		rv = libusb_handle_events_timeout_completed(ctx, &tv,
+			&event_thread_exit);
+#endif
+		if ((rv < 0) && (rv != LIBUSB_ERROR_INTERRUPTED))
+		{
+			DEBUG_CRITICAL2("libusb_handle_events failed: %s",
+				libusb_error_name(rv));
+
+			/* wait a bit to avoid a fast error loop */
+			(void)usleep(100*1000);
+		}
+	}
+
+	DEBUG_INFO1("Event thread terminated");
+
+	return NULL;
+} /* EventProc */
+
 /*****************************************************************************
  *
  *					OpenUSB
@@ -168,9 +648,13 @@ status_t OpenUSB(CcidDesc * ccid_reader, /*@unused@*/ int Channel)
 status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 {
 	_usbDevice * usb_device = &ccid_reader->device;
-	unsigned int alias;
+#ifdef USE_COMPILED_READER_DB
+	const struct readerDbEntry *reader_entry;
+#else
+	int alias;
+	list_t *ifdVendorID, *ifdProductID, *ifdFriendlyName;
+#endif
 	struct libusb_device_handle *dev_handle;
-	char infofile[FILENAME_MAX];
 #ifndef __APPLE__
 	unsigned int device_vendor, device_product;
 	unsigned int device_bus = 0;
@@ -185,11 +669,14 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 	static CcidDesc * previous_ccid_reader = NULL;
 	libusb_device **devs, *dev;
 	ssize_t cnt;
-	list_t plist, *values, *ifdVendorID, *ifdProductID, *ifdFriendlyName;
+#ifndef USE_COMPILED_READER_DB
+	struct bundleCache *bundle;
+	list_t *plist, *values;
+#endif
 	int rv;
 	bool claim_failed = false;
+	bool scan_bus = false;
 	int return_value = STATUS_SUCCESS;
-	const char * hpDirPath;
 #ifdef USE_COMPOSITE_AS_MULTISLOT
 	/* use the first CCID interface on first call */
 	static int static_interface = -1;
@@ -258,25 +745,18 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 		return STATUS_UNSUCCESSFUL;
 	}
 
-	/* Check if path override present in environment */
-	hpDirPath = SYS_GetEnv("PCSCLITE_HP_DROPDIR");
-	if (NULL == hpDirPath)
-		hpDirPath = PCSCLITE_HP_DROPDIR;
-
-	/* Info.plist full patch filename */
-	(void)snprintf(infofile, sizeof(infofile), "%s/%s/Contents/Info.plist",
-		hpDirPath, BUNDLE);
-	DEBUG_INFO2("Using: " LOG_STRING, infofile);
-
-	rv = bundleParse(infofile, &plist);
-	if (rv)
+#ifndef USE_COMPILED_READER_DB
+	/* Info.plist is parsed again only if it has been modified */
+	bundle = BundleCacheGet();
+	if (NULL == bundle)
 		return STATUS_UNSUCCESSFUL;
+	plist = &bundle->plist;
 
 #define GET_KEY(key, values) \
-	rv = LTPBundleFindValueWithKey(&plist, key, &values); \
+	rv = LTPBundleFindValueWithKey(plist, key, &values); \
 	if (rv) \
 	{ \
-		DEBUG_CRITICAL2("Value/Key not defined for " key " in %s", infofile); \
+		DEBUG_CRITICAL2("Value/Key not defined for " key " in %s", bundle->infofile); \
 		return_value = STATUS_UNSUCCESSFUL; \
 		goto end1; \
 	} \
@@ -287,6 +767,7 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 	GET_KEY("ifdManufacturerString", values)
 	GET_KEY("ifdProductString", values)
 	GET_KEY("Copyright", values)
+#endif
 
 	if (NULL == ctx)
 	{
@@ -297,13 +778,33 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 			return_value = STATUS_UNSUCCESSFUL;
 			goto end1;
 		}
+
+#ifdef HAVE_LIBUSB_HOTPLUG
+		if (DriverOptions & DRIVER_OPTION_USB_HOTPLUG)
+			hotplug_register();
+#endif
+
+		event_thread_exit = 0;
+		rv = pthread_create(&event_thread, NULL, EventProc, NULL);
+		if (rv != 0)
+		{
+			DEBUG_CRITICAL2("pthread_create failed: %s", strerror(rv));
+#ifdef HAVE_LIBUSB_HOTPLUG
+			hotplug_deregister();
+#endif
+			libusb_exit(ctx);
+			ctx = NULL;
+			return_value = STATUS_UNSUCCESSFUL;
+			goto end1;
+		}
 	}
 
+#ifndef USE_COMPILED_READER_DB
 #define GET_KEYS(key, values) \
-	rv = LTPBundleFindValueWithKey(&plist, key, values); \
+	rv = LTPBundleFindValueWithKey(plist, key, values); \
 	if (rv) \
 	{ \
-		DEBUG_CRITICAL2("Value/Key not defined for " key " in %s", infofile); \
+		DEBUG_CRITICAL2("Value/Key not defined for " key " in %s", bundle->infofile); \
 		return_value = STATUS_UNSUCCESSFUL; \
 		goto end1; \
 	}
@@ -316,15 +817,24 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device)
 	if ((list_size(ifdVendorID) != list_size(ifdProductID))
 		|| (list_size(ifdVendorID) != list_size(ifdFriendlyName)))
 	{
-		DEBUG_CRITICAL2("Error parsing %s", infofile);
+		DEBUG_CRITICAL2("Error parsing %s", bundle->infofile);
+		return_value = STATUS_UNSUCCESSFUL;
+		goto end1;
+	}
+
+	/* vendor/product index built again only if Info.plist changed */
+	if (! build_alias_index(ifdVendorID, ifdProductID, bundle->generation))
+	{
 		return_value = STATUS_UNSUCCESSFUL;
 		goto end1;
 	}
+#endif
 
 #ifdef __APPLE__
 again_libusb:
 #endif
-	cnt = libusb_get_device_list(ctx, &devs);
+again_scan:
+	cnt = get_device_list(&devs, scan_bus);
 	if (cnt < 0)
 	{
 		DEBUG_CRITICAL("libusb_get_device_list() failed\n");
@@ -332,543 +842,620 @@ again_libusb:
 		goto end1;
 	}
 
-	/* for any supported reader */
-	for (alias=0; alias<list_size(ifdVendorID); alias++)
+	/* for every device */
+	i = 0;
+	while ((dev = devs[i++]) != NULL)
 	{
+		struct libusb_device_descriptor desc;
+		struct libusb_config_descriptor *config_desc;
+		uint8_t bus_number = libusb_get_bus_number(dev);
+		uint8_t device_address = libusb_get_device_address(dev);
 		unsigned int vendorID, productID;
 #ifndef NO_LOG
-		char *friendlyName;
-		friendlyName = list_get_at(ifdFriendlyName, alias);
+		const char *friendlyName;
+#endif
+
+#ifndef __APPLE__
+		if ((device_bus || device_addr)
+			&& ((bus_number != device_bus)
+			|| (device_address != device_addr))) {
+			/* not the USB device we are looking for */
+			continue;
+		}
 #endif
+		DEBUG_COMM3("Try device: %d/%d", bus_number, device_address);
+
+		int r = libusb_get_device_descriptor(dev, &desc);
+		if (r < 0)
+		{
+			DEBUG_INFO3("failed to get device descriptor for %d/%d",
+				bus_number, device_address);
+			continue;
+		}
 
-		vendorID = strtoul(list_get_at(ifdVendorID, alias), NULL, 0);
-		productID = strtoul(list_get_at(ifdProductID, alias), NULL, 0);
+		DEBUG_COMM3("vid/pid : %04X/%04X", desc.idVendor, desc.idProduct);
 
 #ifndef __APPLE__
 		/* the device was specified but is not the one we are trying to find */
 		if (device
-			&& (vendorID != device_vendor || productID != device_product))
+			&& (desc.idVendor != device_vendor || desc.idProduct != device_product))
+			continue;
+#endif
+
+		/* is it a supported reader? */
+#ifdef USE_COMPILED_READER_DB
+		reader_entry = find_reader_db(desc.idVendor, desc.idProduct, device);
+		if (NULL == reader_entry)
 			continue;
 #else
-		/* Leopard puts the friendlyname in the device argument */
-		if (device && strcmp(device, friendlyName))
+		alias = find_reader_alias(desc.idVendor, desc.idProduct, device,
+			ifdFriendlyName);
+		if (alias < 0)
 			continue;
 #endif
 
-		/* for every device */
-		i = 0;
-		while ((dev = devs[i++]) != NULL)
-		{
-			struct libusb_device_descriptor desc;
-			struct libusb_config_descriptor *config_desc;
-			uint8_t bus_number = libusb_get_bus_number(dev);
-			uint8_t device_address = libusb_get_device_address(dev);
-
-#ifndef __APPLE__
-			if ((device_bus || device_addr)
-				&& ((bus_number != device_bus)
-				|| (device_address != device_addr))) {
-				/* not the USB device we are looking for */
-				continue;
-			}
+		vendorID = desc.idVendor;
+		productID = desc.idProduct;
+#ifndef NO_LOG
+#ifdef USE_COMPILED_READER_DB
+		friendlyName = reader_entry->friendlyName;
+#else
+		friendlyName = list_get_at(ifdFriendlyName, alias);
+#endif
 #endif
-			DEBUG_COMM3("Try device: %d/%d", bus_number, device_address);
 
-			int r = libusb_get_device_descriptor(dev, &desc);
-			if (r < 0)
-			{
-				DEBUG_INFO3("failed to get device descriptor for %d/%d",
-					bus_number, device_address);
-				continue;
-			}
-
-			DEBUG_COMM3("vid/pid : %04X/%04X", desc.idVendor, desc.idProduct);
-
-			if (desc.idVendor == vendorID && desc.idProduct == productID)
-			{
-				bool already_used;
-				const struct libusb_interface *usb_interface = NULL;
-				int interface;
-				int num = 0;
-				const unsigned char *device_descriptor;
-				int readerID = (vendorID << 16) + productID;
+		bool already_used;
+		const struct libusb_interface *usb_interface = NULL;
+		int interface;
+		int num = 0;
+		const unsigned char *device_descriptor;
+		int readerID = (vendorID << 16) + productID;
 
 #ifdef USE_COMPOSITE_AS_MULTISLOT
-				/* use the first CCID interface on first call */
-				int max_interface_number = -1;
-				int num_CCID_interfaces = 1;
-
-				/*
-				 * We can't talk to the two CCID interfaces
-				 * at the same time (the reader enters a
-				 * dead lock). So we simulate a multi slot
-				 * reader. By default multi slot readers
-				 * can't use the slots at the same time. See
-				 * TAG_IFD_SLOT_THREAD_SAFE
-				 *
-				 * One side effect is that the two readers
-				 * are seen by pcscd as one reader so the
-				 * interface name is the same for the two.
-				 *
-	* So we have:
-	* 0: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 00
-	* 1: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 01
-	* instead of
-	* 0: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 00
-	* 1: Gemalto Prox-DU [Prox-DU Contactless_09A00795] (09A00795) 01 00
-				 */
-
-				/* simulate a composite device as when libudev is used */
-				switch (readerID)
-				{
-					/* For the HID Omnikey 5422 the interfaces are:
-					 * 0: OMNIKEY 5422CL Smartcard Reader
-					 * 1: OMNIKEY 5422 Smartcard Reader
-					 */
-					case HID_OMNIKEY_5422:
-					case ALCOR_LINK_AK9567:
-					case ALCOR_LINK_AK9572:
-					case ACS_WALLETMATE:
-					case ACS_ACR1251:
-					case ACS_ACR1252:
-					case ACS_ACR1252IMP:
-					case ACS_ACR1552:
-						max_interface_number = 1; /* 2 interfaces */
-						num_CCID_interfaces = 2;  /* 2 CCID interfaces */
-						break;
+		/* use the first CCID interface on first call */
+		int max_interface_number = -1;
+		int num_CCID_interfaces = 1;
+
+		/*
+		 * We can't talk to the two CCID interfaces
+		 * at the same time (the reader enters a
+		 * dead lock). So we simulate a multi slot
+		 * reader. By default multi slot readers
+		 * can't use the slots at the same time. See
+		 * TAG_IFD_SLOT_THREAD_SAFE
+		 *
+		 * One side effect is that the two readers
+		 * are seen by pcscd as one reader so the
+		 * interface name is the same for the two.
+		 *
+* So we have:
+* 0: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 00
+* 1: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 01
+* instead of
+* 0: Gemalto Prox-DU [Prox-DU Contact_09A00795] (09A00795) 00 00
+* 1: Gemalto Prox-DU [Prox-DU Contactless_09A00795] (09A00795) 01 00
+		 */
 
-					/* For the Gemalto Prox-DU/SU the interfaces are:
-					 * 0: Prox-DU HID (not used)
-					 * 1: Prox-DU Contactless (CCID)
-					 * 2: Prox-DU Contact (CCID)
-					 */
-					case GEMALTOPROXDU:
-					case GEMALTOPROXSU:
-						max_interface_number = 2; /* 3 interfaces */
-						num_CCID_interfaces = 2;  /* 2 CCID interfaces */
-						break;
+		/* simulate a composite device as when libudev is used */
+		switch (readerID)
+		{
+			/* For the HID Omnikey 5422 the interfaces are:
+			 * 0: OMNIKEY 5422CL Smartcard Reader
+			 * 1: OMNIKEY 5422 Smartcard Reader
+			 */
+			case HID_OMNIKEY_5422:
+			case ALCOR_LINK_AK9567:
+			case ALCOR_LINK_AK9572:
+			case ACS_WALLETMATE:
+			case ACS_ACR1251:
+			case ACS_ACR1252:
+			case ACS_ACR1252IMP:
+			case ACS_ACR1552:
+				max_interface_number = 1; /* 2 interfaces */
+				num_CCID_interfaces = 2;  /* 2 CCID interfaces */
+				break;
 
-					case ACS_ACR1581:
-						max_interface_number = 2; /* 3 interfaces */
-						num_CCID_interfaces = 3;  /* 3 CCID interfaces */
-						break;
+			/* For the Gemalto Prox-DU/SU the interfaces are:
+			 * 0: Prox-DU HID (not used)
+			 * 1: Prox-DU Contactless (CCID)
+			 * 2: Prox-DU Contact (CCID)
+			 */
+			case GEMALTOPROXDU:
+			case GEMALTOPROXSU:
+				max_interface_number = 2; /* 3 interfaces */
+				num_CCID_interfaces = 2;  /* 2 CCID interfaces */
+				break;
 
-					/* For the Feitian R502 the interfaces are:
-					 * 0: R502 Contactless Reader (CCID)
-					 * 1: R502 Contact Reader (CCID)
-					 * 2: R502 SAM1 Reader (CCID)
-					 * 3: R502 SAM2 Reader (CCID)
-					 */
-					case FEITIANR502DUAL:
-						max_interface_number = 3; /* 4 interfaces */
-						num_CCID_interfaces = 4;  /* 4 CCID interfaces */
-						break;
+			case ACS_ACR1581:
+				max_interface_number = 2; /* 3 interfaces */
+				num_CCID_interfaces = 3;  /* 3 CCID interfaces */
+				break;
 
-					/* Kap-eCV: only the first interface is a CCID one
-					 * 0: CCID contactless
-					 * 1: HID
-					 * 2: CDC
-					 * We need to handle this case here even if
-					 * because we have a generic test for all Kapelse
-					 * readers (VENDOR_KAPELSE) later in the code
-					 */
-					case KAPELSE_KAPECV:
-						max_interface_number = 0;
-						num_CCID_interfaces = 1;
-						break;
+			/* For the Feitian R502 the interfaces are:
+			 * 0: R502 Contactless Reader (CCID)
+			 * 1: R502 Contact Reader (CCID)
+			 * 2: R502 SAM1 Reader (CCID)
+			 * 3: R502 SAM2 Reader (CCID)
+			 */
+			case FEITIANR502DUAL:
+				max_interface_number = 3; /* 4 interfaces */
+				num_CCID_interfaces = 4;  /* 4 CCID interfaces */
+				break;
 
-					/* Kap&Link2: only 3 first interfaces are CCID ones
-					 * 0: CCID contact
-					 * 1: CCID contactless
-					 * 2: CCID contactless
-					 * or, depending on user configuration:
-					 * 0: CCID contact
-					 * 1: CCID contactless
-					 * 2: CCID contactless
-					 * 3: CDC-ACM
-					 */
-					case KAPELSE_KAPLIN2:
-						max_interface_number = 2;
-						num_CCID_interfaces = 3;
-						break;
-				}
+			/* Kap-eCV: only the first interface is a CCID one
+			 * 0: CCID contactless
+			 * 1: HID
+			 * 2: CDC
+			 * We need to handle this case here even if
+			 * because we have a generic test for all Kapelse
+			 * readers (VENDOR_KAPELSE) later in the code
+			 */
+			case KAPELSE_KAPECV:
+				max_interface_number = 0;
+				num_CCID_interfaces = 1;
+				break;
 
-				interface_number = static_interface;
+			/* Kap&Link2: only 3 first interfaces are CCID ones
+			 * 0: CCID contact
+			 * 1: CCID contactless
+			 * 2: CCID contactless
+			 * or, depending on user configuration:
+			 * 0: CCID contact
+			 * 1: CCID contactless
+			 * 2: CCID contactless
+			 * 3: CDC-ACM
+			 */
+			case KAPELSE_KAPLIN2:
+				max_interface_number = 2;
+				num_CCID_interfaces = 3;
+				break;
+		}
+
+		interface_number = static_interface;
 #endif
-				/* is it already opened? */
-				already_used = false;
+		/* is it already opened? */
+		already_used = false;
 
-				DEBUG_COMM3("Checking device: %d/%d",
-					bus_number, device_address);
-				for (r=0; r<ccid_driver_max_readers; r++)
+		DEBUG_COMM3("Checking device: %d/%d",
+			bus_number, device_address);
+		for (r=0; r<ccid_driver_max_readers; r++)
+		{
+			if (CcidSlots[r]->device.dev_handle)
+			{
+				/* same bus, same address */
+				if (CcidSlots[r]->device.bus_number == bus_number
+					&& CcidSlots[r]->device.device_address == device_address)
+					already_used = true;
+			}
+		}
+
+		/* this reader is already managed by us */
+		if (already_used)
+		{
+			if ((previous_ccid_reader != NULL)
+				&& previous_ccid_reader->device.dev_handle
+				&& (previous_ccid_reader->device.bus_number == bus_number)
+				&& (previous_ccid_reader->device.device_address == device_address)
+				&& previous_ccid_reader->device.ccid.bCurrentSlotIndex < previous_ccid_reader->device.ccid.bMaxSlotIndex)
+			{
+				struct usbTransfer *write_transfer;
+
+				/* each slot has its own write transfer */
+				write_transfer = alloc_usb_transfer(
+					previous_ccid_reader->device.dev_handle,
+					previous_ccid_reader->device.ccid.dwMaxCCIDMessageLength);
+				if (NULL == write_transfer)
 				{
-					if (CcidSlots[r]->device.dev_handle)
-					{
-						/* same bus, same address */
-						if (CcidSlots[r]->device.bus_number == bus_number
-							&& CcidSlots[r]->device.device_address == device_address)
-							already_used = true;
-					}
+					DEBUG_CRITICAL("transfer allocation failed");
+					return_value = STATUS_UNSUCCESSFUL;
+					goto end2;
 				}
 
-				/* this reader is already managed by us */
-				if (already_used)
+				/* we reuse the same device
+				 * and the reader is multi-slot */
+				*usb_device = previous_ccid_reader->device;
+				usb_device->write_transfer = write_transfer;
+				/* The other slots of GemCore SIM Pro firmware
+				 * 1.0 do not have the same data rates.
+				 * Firmware 2.0 do not have this limitation */
+				if ((GEMCOREPOSPRO == readerID)
+					|| ((GEMCORESIMPRO == readerID)
+					&& (usb_device->ccid.IFD_bcdDevice < 0x0200)))
 				{
-					if ((previous_ccid_reader != NULL)
-						&& previous_ccid_reader->device.dev_handle
-						&& (previous_ccid_reader->device.bus_number == bus_number)
-						&& (previous_ccid_reader->device.device_address == device_address)
-						&& previous_ccid_reader->device.ccid.bCurrentSlotIndex < previous_ccid_reader->device.ccid.bMaxSlotIndex)
+					/* Allocate a memory buffer that will be
+					 * released in CloseUSB() */
+					void *ptr = malloc(sizeof SerialCustomDataRates);
+					if (ptr)
 					{
-						/* we reuse the same device
-						 * and the reader is multi-slot */
-						*usb_device = previous_ccid_reader->device;
-						/* The other slots of GemCore SIM Pro firmware
-						 * 1.0 do not have the same data rates.
-						 * Firmware 2.0 do not have this limitation */
-						if ((GEMCOREPOSPRO == readerID)
-							|| ((GEMCORESIMPRO == readerID)
-							&& (usb_device->ccid.IFD_bcdDevice < 0x0200)))
-						{
-							/* Allocate a memory buffer that will be
-							 * released in CloseUSB() */
-							void *ptr = malloc(sizeof SerialCustomDataRates);
-							if (ptr)
-							{
-								memcpy(ptr, SerialCustomDataRates,
-									sizeof SerialCustomDataRates);
-							}
-
-							usb_device->ccid.arrayOfSupportedDataRates = ptr;
-							usb_device->ccid.dwMaxDataRate = 125000;
-						}
-
-						*usb_device->nb_opened_slots += 1;
-						usb_device->ccid.bCurrentSlotIndex++;
-						usb_device->ccid.dwSlotStatus =
-							IFD_ICC_PRESENT;
-						DEBUG_INFO2("Opening slot: %d",
-							usb_device->ccid.bCurrentSlotIndex);
-
-						/* This is a multislot reader
-						 * Init the multislot stuff for this next slot */
-						usb_device->multislot_extension = previous_ccid_reader->device.multislot_extension;
-						usb_device->previous_slot = previous_ccid_reader;
-						goto end;
+						memcpy(ptr, SerialCustomDataRates,
+							sizeof SerialCustomDataRates);
 					}
-					else
-					{
-						/* if an interface number is given by udev we
-						 * continue with this device. */
-						if (-1 == interface_number)
-						{
-							DEBUG_INFO3("USB device %d/%d already in use."
-								" Checking next one.",
-								bus_number, device_address);
-							continue;
-						}
-					}
-				}
 
-				DEBUG_COMM3("Trying to open USB bus/device: %d/%d",
-					bus_number, device_address);
+					usb_device->ccid.arrayOfSupportedDataRates = ptr;
+					usb_device->ccid.dwMaxDataRate = 125000;
+				}
 
-				r = libusb_open(dev, &dev_handle);
-				if (r < 0)
+				*usb_device->nb_opened_slots += 1;
+				usb_device->ccid.bCurrentSlotIndex++;
+				usb_device->ccid.dwSlotStatus =
+					IFD_ICC_PRESENT;
+				DEBUG_INFO2("Opening slot: %d",
+					usb_device->ccid.bCurrentSlotIndex);
+
+				/* This is a multislot reader
+				 * Init the multislot stuff for this next slot */
+				usb_device->multislot_extension = previous_ccid_reader->device.multislot_extension;
+				usb_device->previous_slot = previous_ccid_reader;
+				goto end;
+			}
+			else
+			{
+				/* if an interface number is given by udev we
+				 * continue with this device. */
+				if (-1 == interface_number)
 				{
-					DEBUG_CRITICAL4("Can't libusb_open(%d/%d): %s",
-						bus_number, device_address, libusb_error_name(r));
-
+					DEBUG_INFO3("USB device %d/%d already in use."
+						" Checking next one.",
+						bus_number, device_address);
 					continue;
 				}
+			}
+		}
+
+		DEBUG_COMM3("Trying to open USB bus/device: %d/%d",
+			bus_number, device_address);
+
+		r = libusb_open(dev, &dev_handle);
+		if (r < 0)
+		{
+			DEBUG_CRITICAL4("Can't libusb_open(%d/%d): %s",
+				bus_number, device_address, libusb_error_name(r));
+
+			continue;
+		}
 
 again:
-				r = libusb_get_active_config_descriptor(dev, &config_desc);
+		r = libusb_get_active_config_descriptor(dev, &config_desc);
+		if (r < 0)
+		{
+#ifdef __APPLE__
+			/* Some early Gemalto Ezio CB+ readers have
+			 * bDeviceClass, bDeviceSubClass and bDeviceProtocol set
+			 * to 0xFF (proprietary) instead of 0x00.
+			 *
+			 * So on Mac OS X the reader configuration is not done
+			 * by the OS/kernel and we do it ourself.
+			 */
+			if ((0xFF == desc.bDeviceClass)
+				&& (0xFF == desc.bDeviceSubClass)
+				&& (0xFF == desc.bDeviceProtocol))
+			{
+				r = libusb_set_configuration(dev_handle, 1);
 				if (r < 0)
 				{
-#ifdef __APPLE__
-					/* Some early Gemalto Ezio CB+ readers have
-					 * bDeviceClass, bDeviceSubClass and bDeviceProtocol set
-					 * to 0xFF (proprietary) instead of 0x00.
-					 *
-					 * So on Mac OS X the reader configuration is not done
-					 * by the OS/kernel and we do it ourself.
-					 */
-					if ((0xFF == desc.bDeviceClass)
-						&& (0xFF == desc.bDeviceSubClass)
-						&& (0xFF == desc.bDeviceProtocol))
-					{
-						r = libusb_set_configuration(dev_handle, 1);
-						if (r < 0)
-						{
-							(void)libusb_close(dev_handle);
-							DEBUG_CRITICAL4("Can't set configuration on %d/%d: %s",
-									bus_number, device_address,
-									libusb_error_name(r));
-							continue;
-						}
-					}
+					(void)libusb_close(dev_handle);
+					DEBUG_CRITICAL4("Can't set configuration on %d/%d: %s",
+							bus_number, device_address,
+							libusb_error_name(r));
+					continue;
+				}
+			}
 
-					/* recall */
-					r = libusb_get_active_config_descriptor(dev, &config_desc);
-					if (r < 0)
-					{
+			/* recall */
+			r = libusb_get_active_config_descriptor(dev, &config_desc);
+			if (r < 0)
+			{
 #endif
-						(void)libusb_close(dev_handle);
-						DEBUG_CRITICAL4("Can't get config descriptor on %d/%d: %s",
-							bus_number, device_address, libusb_error_name(r));
-						continue;
-					}
+				(void)libusb_close(dev_handle);
+				DEBUG_CRITICAL4("Can't get config descriptor on %d/%d: %s",
+					bus_number, device_address, libusb_error_name(r));
+				continue;
+			}
 #ifdef __APPLE__
-				}
+		}
 #endif
 
 #ifdef USE_COMPOSITE_AS_MULTISLOT
-				if ((VENDOR_KAPELSE == GET_VENDOR(readerID))
-					&& (-1 == max_interface_number))
-				{
-					/* Kapelse: all interfaces are CCID ones */
-					num_CCID_interfaces = config_desc->bNumInterfaces;
-					max_interface_number = num_CCID_interfaces-1;
-				}
+		if ((VENDOR_KAPELSE == GET_VENDOR(readerID))
+			&& (-1 == max_interface_number))
+		{
+			/* Kapelse: all interfaces are CCID ones */
+			num_CCID_interfaces = config_desc->bNumInterfaces;
+			max_interface_number = num_CCID_interfaces-1;
+		}
 #endif
 
-				usb_interface = get_ccid_usb_interface(config_desc, &num);
-				if (usb_interface == NULL)
-				{
-					libusb_free_config_descriptor(config_desc);
-					(void)libusb_close(dev_handle);
-					if (0 == num)
-						DEBUG_CRITICAL3("Can't find a CCID interface on %d/%d",
-							bus_number, device_address);
-					interface_number = -1;
-					continue;
-				}
+		usb_interface = get_ccid_usb_interface(config_desc, &num);
+		if (usb_interface == NULL)
+		{
+			libusb_free_config_descriptor(config_desc);
+			(void)libusb_close(dev_handle);
+			if (0 == num)
+				DEBUG_CRITICAL3("Can't find a CCID interface on %d/%d",
+					bus_number, device_address);
+			interface_number = -1;
+			continue;
+		}
 
-				device_descriptor = get_ccid_device_descriptor(usb_interface);
-				if (NULL == device_descriptor)
-				{
-					libusb_free_config_descriptor(config_desc);
-					(void)libusb_close(dev_handle);
-					DEBUG_CRITICAL3("Unable to find the device descriptor for %d/%d",
-						bus_number, device_address);
-					return_value = STATUS_UNSUCCESSFUL;
-					goto end2;
-				}
+		device_descriptor = get_ccid_device_descriptor(usb_interface);
+		if (NULL == device_descriptor)
+		{
+			libusb_free_config_descriptor(config_desc);
+			(void)libusb_close(dev_handle);
+			DEBUG_CRITICAL3("Unable to find the device descriptor for %d/%d",
+				bus_number, device_address);
+			return_value = STATUS_UNSUCCESSFUL;
+			goto end2;
+		}
 
-				interface = usb_interface->altsetting->bInterfaceNumber;
-				if (interface_number >= 0 && interface != interface_number)
-				{
-					libusb_free_config_descriptor(config_desc);
-					/* an interface was specified and it is not the
-					 * current one */
-					DEBUG_INFO3("Found interface %d but expecting %d",
-						interface, interface_number);
-					DEBUG_INFO3("Wrong interface for USB device %d/%d."
-						" Checking next one.", bus_number, device_address);
-
-					/* check for another CCID interface on the same device */
-					num++;
-
-					goto again;
-				}
+		interface = usb_interface->altsetting->bInterfaceNumber;
+		if (interface_number >= 0 && interface != interface_number)
+		{
+			libusb_free_config_descriptor(config_desc);
+			/* an interface was specified and it is not the
+			 * current one */
+			DEBUG_INFO3("Found interface %d but expecting %d",
+				interface, interface_number);
+			DEBUG_INFO3("Wrong interface for USB device %d/%d."
+				" Checking next one.", bus_number, device_address);
 
-				r = libusb_claim_interface(dev_handle, interface);
-				if (r < 0)
-				{
-					libusb_free_config_descriptor(config_desc);
-					(void)libusb_close(dev_handle);
-					DEBUG_CRITICAL4("Can't claim interface %d/%d: %s",
-						bus_number, device_address, libusb_error_name(r));
-					claim_failed = true;
-					interface_number = -1;
-					continue;
-				}
+			/* check for another CCID interface on the same device */
+			num++;
 
-				DEBUG_INFO4("Found Vendor/Product: %04X/%04X (" LOG_STRING ")",
-					desc.idVendor, desc.idProduct, friendlyName);
-				DEBUG_INFO3("Using USB bus/device: %d/%d",
-					bus_number, device_address);
+			goto again;
+		}
 
-				/* check for firmware bugs */
-				if (ccid_check_firmware(&desc))
-				{
-					libusb_free_config_descriptor(config_desc);
-					(void)libusb_close(dev_handle);
-					return_value = STATUS_UNSUCCESSFUL;
-					goto end2;
-				}
+		r = libusb_claim_interface(dev_handle, interface);
+		if (r < 0)
+		{
+			libusb_free_config_descriptor(config_desc);
+			(void)libusb_close(dev_handle);
+			DEBUG_CRITICAL4("Can't claim interface %d/%d: %s",
+				bus_number, device_address, libusb_error_name(r));
+			claim_failed = true;
+			interface_number = -1;
+			continue;
+		}
+
+		DEBUG_INFO4("Found Vendor/Product: %04X/%04X (" LOG_STRING ")",
+			desc.idVendor, desc.idProduct, friendlyName);
+		DEBUG_INFO3("Using USB bus/device: %d/%d",
+			bus_number, device_address);
+
+		/* check for firmware bugs */
+		if (ccid_check_firmware(&desc))
+		{
+			libusb_free_config_descriptor(config_desc);
+			(void)libusb_close(dev_handle);
+			return_value = STATUS_UNSUCCESSFUL;
+			goto end2;
+		}
+
+		/* preallocate the transfers. ICCD readers do not use
+		 * the bulk endpoints and multislot readers receive the
+		 * frames in the buffers of Multi_ReadProc() */
+		{
+			int bulk_size = 0;
+
+			if ((PROTOCOL_CCID == usb_interface->altsetting->bInterfaceProtocol)
+				&& (0 == device_descriptor[4]))
+				bulk_size = BULK_IN_BUFFER_SIZE;
+
+			usb_device->write_transfer = alloc_usb_transfer(dev_handle,
+				dw2i(device_descriptor, 44));
+			usb_device->read_transfer = alloc_usb_transfer(dev_handle,
+				bulk_size);
+			usb_device->interrupt_transfer = alloc_usb_transfer(dev_handle,
+				CCID_INTERRUPT_SIZE);
+			if ((NULL == usb_device->write_transfer)
+				|| (NULL == usb_device->read_transfer)
+				|| (NULL == usb_device->interrupt_transfer))
+			{
+				DEBUG_CRITICAL("transfer allocation failed");
+				free_usb_transfer(dev_handle, usb_device->write_transfer);
+				free_usb_transfer(dev_handle, usb_device->read_transfer);
+				free_usb_transfer(dev_handle, usb_device->interrupt_transfer);
+				usb_device->write_transfer = NULL;
+				usb_device->read_transfer = NULL;
+				usb_device->interrupt_transfer = NULL;
+				libusb_free_config_descriptor(config_desc);
+				(void)libusb_close(dev_handle);
+				return_value = STATUS_UNSUCCESSFUL;
+				goto end2;
+			}
+		}
 
 #ifdef USE_COMPOSITE_AS_MULTISLOT
-				/* only if max_interface_number has a value set earlier */
-				if (max_interface_number >= 0)
-				{
-					/* use the next interface for the next "slot" */
-					static_interface = interface + 1;
+		/* only if max_interface_number has a value set earlier */
+		if (max_interface_number >= 0)
+		{
+			/* use the next interface for the next "slot" */
+			static_interface = interface + 1;
 
-					/* reset for a next reader */
-					if (static_interface > max_interface_number)
-						static_interface = -1;
-				}
+			/* reset for a next reader */
+			if (static_interface > max_interface_number)
+				static_interface = -1;
+		}
 #endif
 
-				/* Get Endpoints values*/
-				(void)get_end_points(usb_interface, usb_device);
-
-				/* store device information */
-				usb_device->dev_handle = dev_handle;
-				usb_device->bus_number = bus_number;
-				usb_device->device_address = device_address;
-				usb_device->interface = interface;
-				usb_device->real_nb_opened_slots = 1;
-				usb_device->nb_opened_slots = &usb_device->real_nb_opened_slots;
-				usb_device->previous_slot = NULL;
-				pthread_mutex_init(&usb_device->polling_transfer_mutex, NULL);
-				usb_device->polling_transfer = NULL;
-				usb_device->terminate_requested = false;
-				usb_device->disconnected = false;
-
-				/* CCID common information */
+		/* Get Endpoints values*/
+		(void)get_end_points(usb_interface, usb_device);
+
+		/* store device information */
+		usb_device->dev_handle = dev_handle;
+		usb_device->bus_number = bus_number;
+		usb_device->device_address = device_address;
+		usb_device->interface = interface;
+		usb_device->real_nb_opened_slots = 1;
+		usb_device->nb_opened_slots = &usb_device->real_nb_opened_slots;
+		usb_device->previous_slot = NULL;
+		pthread_mutex_init(&usb_device->polling_transfer_mutex, NULL);
+		usb_device->polling_transfer = NULL;
+		usb_device->terminate_requested = false;
+		usb_device->presence.state = PRESENCE_UNTRACKED;
+		usb_device->presence.events = 0;
+		usb_device->disconnected = false;
+
+		/* CCID common information */
 #ifdef USE_COMPOSITE_AS_MULTISLOT
-				usb_device->ccid.num_interfaces = num_CCID_interfaces;
+		usb_device->ccid.num_interfaces = num_CCID_interfaces;
 #endif
-				usb_device->ccid.real_bSeq = 0;
-				usb_device->ccid.pbSeq = &usb_device->ccid.real_bSeq;
-				usb_device->ccid.readerID =
-					(desc.idVendor << 16) + desc.idProduct;
-				usb_device->ccid.dwFeatures = dw2i(device_descriptor, 40);
-				usb_device->ccid.wLcdLayout =
-					(device_descriptor[51] << 8) + device_descriptor[50];
-				usb_device->ccid.bPINSupport = device_descriptor[52];
-				usb_device->ccid.dwMaxCCIDMessageLength = dw2i(device_descriptor, 44);
-				usb_device->ccid.dwMaxIFSD = dw2i(device_descriptor, 28);
-				usb_device->ccid.dwDefaultClock = dw2i(device_descriptor, 10);
-				usb_device->ccid.dwMaxDataRate = dw2i(device_descriptor, 23);
-				usb_device->ccid.bMaxSlotIndex = device_descriptor[4];
-				usb_device->ccid.bMaxCCIDBusySlots = device_descriptor[53];
-				usb_device->ccid.bCurrentSlotIndex = 0;
-				usb_device->ccid.readTimeout = DEFAULT_COM_READ_TIMEOUT;
-				if (device_descriptor[27])
-					usb_device->ccid.arrayOfSupportedDataRates = get_data_rates(ccid_reader, device_descriptor[27]);
-				else
-				{
-					usb_device->ccid.arrayOfSupportedDataRates = NULL;
-					DEBUG_INFO1("bNumDataRatesSupported is 0");
-				}
-				usb_device->ccid.bInterfaceProtocol = usb_interface->altsetting->bInterfaceProtocol;
-				usb_device->ccid.bNumEndpoints = usb_interface->altsetting->bNumEndpoints;
-				usb_device->ccid.dwSlotStatus = IFD_ICC_PRESENT;
-				usb_device->ccid.bVoltageSupport = device_descriptor[5];
-				usb_device->ccid.sIFD_serial_number = NULL;
-				usb_device->ccid.gemalto_firmware_features = NULL;
-				usb_device->ccid.dwProtocols = dw2i(device_descriptor, 6);
+		usb_device->ccid.real_bSeq = 0;
+		usb_device->ccid.pbSeq = &usb_device->ccid.real_bSeq;
+		usb_device->ccid.readerID =
+			(desc.idVendor << 16) + desc.idProduct;
+		usb_device->ccid.dwFeatures = dw2i(device_descriptor, 40);
+		usb_device->ccid.wLcdLayout =
+			(device_descriptor[51] << 8) + device_descriptor[50];
+		usb_device->ccid.bPINSupport = device_descriptor[52];
+		usb_device->ccid.dwMaxCCIDMessageLength = dw2i(device_descriptor, 44);
+		usb_device->ccid.dwMaxIFSD = dw2i(device_descriptor, 28);
+		usb_device->ccid.dwDefaultClock = dw2i(device_descriptor, 10);
+		usb_device->ccid.dwMaximumClock = dw2i(device_descriptor, 14);
+		usb_device->ccid.dwMaxDataRate = dw2i(device_descriptor, 23);
+		usb_device->ccid.bMaxSlotIndex = device_descriptor[4];
+		usb_device->ccid.bMaxCCIDBusySlots = device_descriptor[53];
+		usb_device->ccid.bCurrentSlotIndex = 0;
+		usb_device->ccid.readTimeout = DEFAULT_COM_READ_TIMEOUT;
+		if (device_descriptor[27])
+			usb_device->ccid.arrayOfSupportedDataRates = get_supported_values(ccid_reader, 0x03 /* GET_DATA_RATES */, device_descriptor[27]);
+		else
+		{
+			usb_device->ccid.arrayOfSupportedDataRates = NULL;
+			DEBUG_INFO1("bNumDataRatesSupported is 0");
+		}
+		if (device_descriptor[18])
+			usb_device->ccid.arrayOfSupportedClocks = get_supported_values(ccid_reader, 0x02 /* GET_CLOCK_FREQUENCIES */, device_descriptor[18]);
+		else
+		{
+			usb_device->ccid.arrayOfSupportedClocks = NULL;
+			DEBUG_INFO1("bNumClockSupported is 0");
+		}
+		usb_device->ccid.bInterfaceProtocol = usb_interface->altsetting->bInterfaceProtocol;
+		usb_device->ccid.bNumEndpoints = usb_interface->altsetting->bNumEndpoints;
+		usb_device->ccid.dwSlotStatus = IFD_ICC_PRESENT;
+		usb_device->ccid.bVoltageSupport = device_descriptor[5];
+		usb_device->ccid.sIFD_serial_number = NULL;
+		usb_device->ccid.gemalto_firmware_features = NULL;
+		usb_device->ccid.dwProtocols = dw2i(device_descriptor, 6);
 #ifdef ENABLE_ZLP
-				usb_device->ccid.zlp = false;
+		usb_device->ccid.zlp = false;
 #endif
-				if (desc.iSerialNumber)
-				{
-					unsigned char serial[128];
-					int ret;
-
-					ret = libusb_get_string_descriptor_ascii(dev_handle,
-							desc.iSerialNumber, serial,
-							sizeof(serial));
-					if (ret > 0)
-						usb_device->ccid.sIFD_serial_number
-							= strdup((char *)serial);
-				}
+		usb_device->ccid.iccdWaitCount = 0;
+		usb_device->ccid.iccdWaitTime = 0;
+		if (desc.iSerialNumber)
+		{
+			unsigned char serial[128];
+			int ret;
 
-				usb_device->ccid.sIFD_iManufacturer = NULL;
-				if (desc.iManufacturer)
-				{
-					unsigned char iManufacturer[128];
-					int ret;
-
-					ret = libusb_get_string_descriptor_ascii(dev_handle,
-							desc.iManufacturer, iManufacturer,
-							sizeof(iManufacturer));
-					if (ret > 0)
-						usb_device->ccid.sIFD_iManufacturer
-							= strdup((char *)iManufacturer);
-				}
+			ret = libusb_get_string_descriptor_ascii(dev_handle,
+					desc.iSerialNumber, serial,
+					sizeof(serial));
+			if (ret > 0)
+				usb_device->ccid.sIFD_serial_number
+					= strdup((char *)serial);
+		}
 
-				usb_device->ccid.IFD_bcdDevice = desc.bcdDevice;
+		usb_device->ccid.sIFD_iManufacturer = NULL;
+		if (desc.iManufacturer)
+		{
+			unsigned char iManufacturer[128];
+			int ret;
 
-				/* If this is a multislot reader, init the multislot stuff */
-				if (usb_device->ccid.bMaxSlotIndex)
-					usb_device->multislot_extension = Multi_CreateFirstSlot(ccid_reader);
-				else
-					usb_device->multislot_extension = NULL;
+			ret = libusb_get_string_descriptor_ascii(dev_handle,
+					desc.iManufacturer, iManufacturer,
+					sizeof(iManufacturer));
+			if (ret > 0)
+				usb_device->ccid.sIFD_iManufacturer
+					= strdup((char *)iManufacturer);
+		}
 
+		usb_device->ccid.IFD_bcdDevice = desc.bcdDevice;
 
-#ifdef SEC1210_SYNC
-				if (SEC1210 == readerID)
-				{
-					usb_device->ccid.sec1210_interface = interface;
+		/* If this is a multislot reader, init the multislot stuff */
+		if (usb_device->ccid.bMaxSlotIndex)
+			usb_device->multislot_extension = Multi_CreateFirstSlot(ccid_reader);
+		else
+			usb_device->multislot_extension = NULL;
 
-					int other_interface_index = -1;
-					/* search the other interface */
-					for (unsigned int index=0; index<ccid_driver_max_readers ; index++)
-					{
-						/* ourself? */
-						if (index == reader_index)
-							continue;
 
-						/* empty slot */
-						if (! CcidSlots[index].device.dev_handle)
-							continue;
+#ifdef SEC1210_SYNC
+		if (SEC1210 == readerID)
+		{
+			usb_device->ccid.sec1210_interface = interface;
 
-						if (bus_number == CcidSlots[index].device.bus_number
-							&& device_address == CcidSlots[index].device.device_address)
-						{
-							/* found it */
-							other_interface_index = index;
-							DEBUG_INFO2("found other interface at %d", index);
-							break;
-						}
-					}
+			int other_interface_index = -1;
+			/* search the other interface */
+			for (unsigned int index=0; index<ccid_driver_max_readers ; index++)
+			{
+				/* ourself? */
+				if (index == reader_index)
+					continue;
 
-					if (other_interface_index >= 0)
-					{
-						DEBUG_INFO2("init SEC1210 2nd interface: %d",
-							interface);
-						/* point to the previous interface */
-						usb_device->ccid.sec1210_other_interface = &CcidSlots[other_interface_index].device.ccid;
-						/* the previous interface points to us */
-						usb_device->ccid.sec1210_other_interface -> sec1210_other_interface = &CcidSlots[reader_index].device.ccid;
-						/* share the cond struct */
-						usb_device->ccid.sec1210_shared = CcidSlots[other_interface_index].device.ccid.sec1210_shared;
-						/* signal change if first interface comes after second */
-						if (interface == 0) {
-							DEBUG_INFO1("SEC1210: First interface came second, signaling");
-							pthread_cond_signal(&usb_device->ccid.sec1210_shared->sec1210_cond);
-						}
-					}
-					else
-					{
-						DEBUG_INFO2("init SEC1210 1st interface: %d",
-							interface);
+				/* empty slot */
+				if (! CcidSlots[index].device.dev_handle)
+					continue;
 
-						/* init the cond struct */
-						struct _sec1210_cond *s = malloc(sizeof(struct _sec1210_cond));
+				if (bus_number == CcidSlots[index].device.bus_number
+					&& device_address == CcidSlots[index].device.device_address)
+				{
+					/* found it */
+					other_interface_index = index;
+					DEBUG_INFO2("found other interface at %d", index);
+					break;
+				}
+			}
 
-						pthread_cond_init(&s->sec1210_cond, NULL);
-						pthread_mutex_init(&s->sec1210_mutex, NULL);
-						usb_device->ccid.sec1210_shared = s;
-					}
+			if (other_interface_index >= 0)
+			{
+				DEBUG_INFO2("init SEC1210 2nd interface: %d",
+					interface);
+				/* point to the previous interface */
+				usb_device->ccid.sec1210_other_interface = &CcidSlots[other_interface_index].device.ccid;
+				/* the previous interface points to us */
+				usb_device->ccid.sec1210_other_interface -> sec1210_other_interface = &CcidSlots[reader_index].device.ccid;
+				/* share the cond struct */
+				usb_device->ccid.sec1210_shared = CcidSlots[other_interface_index].device.ccid.sec1210_shared;
+				/* signal change if first interface comes after second */
+				if (interface == 0) {
+					DEBUG_INFO1("SEC1210: First interface came second, signaling");
+					pthread_cond_signal(&usb_device->ccid.sec1210_shared->sec1210_cond);
 				}
-#endif
+			}
+			else
+			{
+				DEBUG_INFO2("init SEC1210 1st interface: %d",
+					interface);
 
-				libusb_free_config_descriptor(config_desc);
-				goto end;
+				/* init the cond struct */
+				struct _sec1210_cond *s = malloc(sizeof(struct _sec1210_cond));
+
+				pthread_cond_init(&s->sec1210_cond, NULL);
+				pthread_mutex_init(&s->sec1210_mutex, NULL);
+				usb_device->ccid.sec1210_shared = s;
 			}
 		}
+#endif
+
+		libusb_free_config_descriptor(config_desc);
+		goto end;
 	}
 end:
 	if (usb_device->dev_handle == NULL)
 	{
 		/* free the libusb allocated list & devices */
-		libusb_free_device_list(devs, 1);
+		free_device_list(devs, scan_bus);
+
+#ifdef HAVE_LIBUSB_HOTPLUG
+		/* the hotplug callback of a device just plugged may not have
+		 * been called yet */
+		if (hotplug_registered && ! scan_bus && ! claim_failed)
+		{
+			DEBUG_INFO1("Device not in the hotplug list. Scan the USB bus");
+			scan_bus = true;
+			goto again_scan;
+		}
+#endif
 
 #ifdef __APPLE__
 		/* give some time to libusb to detect the new USB devices on Mac OS X */
@@ -882,8 +1469,10 @@ end:
 		}
 #endif
 
+#ifndef USE_COMPILED_READER_DB
 		/* free bundle list */
-		bundleRelease(&plist);
+		BundleCacheRelease(bundle);
+#endif
 
 		/* failed */
 		close_libusb_if_needed();
@@ -905,11 +1494,13 @@ end:
 
 end2:
 	/* free the libusb allocated list & devices */
-	libusb_free_device_list(devs, 1);
+	free_device_list(devs, scan_bus);
 
 end1:
+#ifndef USE_COMPILED_READER_DB
 	/* free bundle list */
-	bundleRelease(&plist);
+	BundleCacheRelease(bundle);
+#endif
 
 	if (return_value != STATUS_SUCCESS)
 		close_libusb_if_needed();
@@ -925,12 +1516,32 @@ end1:
  ****************************************************************************/
 status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
 	unsigned char *buffer)
+{
+	struct iovec iov = { buffer, length };
+
+	return WritevUSB(ccid_reader, &iov, 1);
+} /* WriteUSB */
+
+
+/*****************************************************************************
+ *
+ *					WritevUSB
+ *
+ ****************************************************************************/
+status_t WritevUSB(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt)
 {
 	_usbDevice * usb_device = &ccid_reader->device;
+	struct usbTransfer *write_transfer = usb_device->write_transfer;
+	const unsigned char *header = iov[0].iov_base;
+	unsigned char *data, *allocated = NULL;
+	unsigned int length = 0;
 	int rv;
-	int actual_length;
 	char debug_header[] = "-> lun: 12345678, ";
 
+	for (int i=0; i<iovcnt; i++)
+		length += iov[i].iov_len;
+
 	(void)snprintf(debug_header, sizeof(debug_header), "-> lun: %X, ",
 		ccid_reader->lun);
 
@@ -952,11 +1563,63 @@ status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
 	}
 #endif
 
-	DEBUG_XXD(debug_header, buffer, length);
+	/* wait until the reader accepts one more busy slot. A command of
+	 * another slot may never complete so the wait is bounded */
+	if (usb_device->multislot_extension && (iov[0].iov_len > BSEQ_OFFSET))
+	{
+		rv = Multi_AcquireSlot(usb_device->multislot_extension,
+			usb_device->ccid.bCurrentSlotIndex, header[BSEQ_OFFSET],
+			usb_device->ccid.readTimeout);
+		if (rv)
+			return STATUS_UNSUCCESSFUL;
+	}
+
+	/* a bulk transfer needs a contiguous buffer. A frame already
+	 * contiguous in the caller memory (see CCID_TransmitInPlace()) is
+	 * sent as is. Otherwise the CCID header and the payload are gathered
+	 * in the buffer preallocated for the slot */
+	if (iov_contiguous(iov, iovcnt))
+		data = iov[0].iov_base;
+	else if (length <= (unsigned int)write_transfer->length)
+		data = write_transfer->buffer;
+	else
+	{
+		/* frame longer than dwMaxCCIDMessageLength */
+		allocated = malloc(length);
+		if (NULL == allocated)
+		{
+			DEBUG_CRITICAL("malloc failed");
+			if (usb_device->multislot_extension)
+				Multi_ReleaseSlot(usb_device->multislot_extension,
+					usb_device->ccid.bCurrentSlotIndex);
+			return STATUS_UNSUCCESSFUL;
+		}
+		data = allocated;
+	}
+
+	if (data != iov[0].iov_base)
+	{
+		unsigned int offset = 0;
+
+		for (int i=0; i<iovcnt; i++)
+		{
+			memcpy(data + offset, iov[i].iov_base, iov[i].iov_len);
+			offset += iov[i].iov_len;
+		}
+	}
+
+	DEBUG_XXD(debug_header, data, length);
+
+	write_transfer->completed = 0;
+	libusb_fill_bulk_transfer(write_transfer->transfer, usb_device->dev_handle,
+		usb_device->bulk_out, data, length,
+		bulk_transfer_cb, write_transfer, USB_WRITE_TIMEOUT);
+
+	rv = libusb_submit_transfer(write_transfer->transfer);
+	if (0 == rv)
+		rv = wait_transfer(write_transfer, 0);
 
-	rv = libusb_bulk_transfer(usb_device->dev_handle,
-		usb_device->bulk_out, buffer, length,
-		&actual_length, USB_WRITE_TIMEOUT);
+	free(allocated);
 
 	if (rv < 0)
 	{
@@ -964,6 +1627,11 @@ status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
 			usb_device->bus_number,
 			usb_device->device_address, libusb_error_name(rv));
 
+		/* no response will come */
+		if (usb_device->multislot_extension)
+			Multi_ReleaseSlot(usb_device->multislot_extension,
+				usb_device->ccid.bCurrentSlotIndex);
+
 		if (LIBUSB_ERROR_NO_DEVICE == rv)
 			return STATUS_NO_SUCH_DEVICE;
 
@@ -971,7 +1639,7 @@ status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
 	}
 
 	return STATUS_SUCCESS;
-} /* WriteUSB */
+} /* WritevUSB */
 
 
 /*****************************************************************************
@@ -980,17 +1648,49 @@ status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
  *
  ****************************************************************************/
 status_t ReadUSB(CcidDesc * ccid_reader, unsigned int * length,
-	unsigned char *buffer, int bSeq)
+	unsigned char *buffer, int bSeq, unsigned int timeout)
+{
+	struct iovec iov = { buffer, *length };
+	status_t ret;
+
+	ret = ReadvUSB(ccid_reader, &iov, 1, length, bSeq, timeout);
+
+	/* the end of a too long frame has been dropped */
+	if (*length > iov.iov_len)
+		*length = iov.iov_len;
+
+	return ret;
+} /* ReadUSB */
+
+
+/*****************************************************************************
+ *
+ *					ReadvUSB
+ *
+ ****************************************************************************/
+status_t ReadvUSB(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt, unsigned int * length, int bSeq, unsigned int timeout)
 {
 	_usbDevice * usb_device = &ccid_reader->device;
+	struct multiSlotFrame *frame = NULL;
+	unsigned char *data, *allocated = NULL;
+	unsigned int size = 0;
 	int rv;
 	int actual_length;
 	char debug_header[] = "<- lun: 12345678, ";
 	int duplicate_frame = 0;
 
+	for (int i=0; i<iovcnt; i++)
+		size += iov[i].iov_len;
+
 	if (usb_device->disconnected)
 	{
 		DEBUG_COMM("Reader disconnected");
+
+		/* the command is abandoned */
+		if (usb_device->multislot_extension)
+			Multi_ReleaseSlot(usb_device->multislot_extension,
+				usb_device->ccid.bCurrentSlotIndex);
 		return STATUS_NO_SUCH_DEVICE;
 	}
 
@@ -1003,74 +1703,115 @@ read_again:
 		/* multi slot read */
 		int slot = usb_device->ccid.bCurrentSlotIndex;
 		struct multiSlot_ConcurrentAccess *concurrent = usb_device->multislot_extension->concurrent;
+		int frame_length = 0;
 
 		rv = 0;
 		pthread_mutex_lock(&concurrent[slot].slot_mutex);
 
 		/* a frame is available? */
-		if (0 == concurrent[slot].length)
+		if (NULL == concurrent[slot].frame)
 		{
-			struct timespec timeout;
-			time_t timeout_sec = usb_device->ccid.readTimeout  / 1000;
-			long timeout_msec = usb_device->ccid.readTimeout - timeout_sec * 1000;
+			struct timespec deadline;
 
 #ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
-			clock_gettime(CLOCK_MONOTONIC, &timeout);
+			deadline_init(&deadline, timeout);
 #else
-			clock_gettime(CLOCK_REALTIME, &timeout);
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline_extend(&deadline, timeout);
 #endif
-			timeout.tv_sec += timeout_sec;
-			timeout.tv_nsec += timeout_msec * 1000 * 1000;
-			if (timeout.tv_nsec > 1000 * 1000 * 1000)
-			{
-				timeout.tv_sec++;
-				timeout.tv_nsec -= 1000 * 1000 * 1000;
-			}
 
 			/* wait for a new frame */
 			DEBUG_COMM2("Waiting data for slot %d", slot);
 			rv = pthread_cond_timedwait(&concurrent[slot].slot_condition,
-				&concurrent[slot].slot_mutex, &timeout);
+				&concurrent[slot].slot_mutex, &deadline);
+		}
+
+		if (rv)
+		{
+			DEBUG_CRITICAL5("read failed (%d/%d): %d %s",
+				usb_device->bus_number,
+				usb_device->device_address, rv, strerror(rv));
+		}
+		else
+		{
+			/* take the ownership of the frame */
+			frame = concurrent[slot].frame;
+			frame_length = concurrent[slot].length;
+			concurrent[slot].frame = NULL;
+			concurrent[slot].length = 0;
+		}
+
+		pthread_mutex_unlock(&concurrent[slot].slot_mutex);
+
+		if (0 == rv)
+		{
+			DEBUG_COMM3("Got %d bytes for slot %d", frame_length, slot);
+			if (0 == frame_length)
+				rv = EINTR;
+		}
+
+		if (rv)
+		{
+			*length = 0;
+
+			/* give the frame back to Multi_ReadProc() */
+			if (frame)
+				Multi_PutFrame(usb_device->multislot_extension, frame);
+
+			/* the command is abandoned */
+			Multi_ReleaseSlot(usb_device->multislot_extension, slot);
+			return STATUS_UNSUCCESSFUL;
+		}
+
+		/* the frame is copied from the Multi_ReadProc() buffer */
+		data = frame->buffer;
+		actual_length = frame_length;
+	}
+	else
+	{
+		struct usbTransfer *read_transfer = usb_device->read_transfer;
+
+		/* the bulk-IN transfer is submitted only now that the
+		 * destination is known. The reader does not send anything
+		 * before a transfer is submitted so no response is lost.
+		 * A frame contiguous in the caller memory (see
+		 * CCID_ReceiveInPlace()) is received directly. Otherwise it is
+		 * received in the preallocated buffer and then scattered in the
+		 * vectors */
+		if (iov_contiguous(iov, iovcnt))
+		{
+			data = iov[0].iov_base;
+			actual_length = size;
 		}
-
-		if (rv)
+		else if (read_transfer->buffer)
 		{
-			*length = 0;
-			DEBUG_CRITICAL5("read failed (%d/%d): %d %s",
-				usb_device->bus_number,
-				usb_device->device_address, rv, strerror(rv));
+			data = read_transfer->buffer;
+			actual_length = read_transfer->length;
 		}
 		else
 		{
-			DEBUG_COMM3("Got %d bytes for slot %d", concurrent[slot].length,
-				slot);
-			if (concurrent[slot].length > 0)
+			allocated = malloc(size);
+			if (NULL == allocated)
 			{
-				if (concurrent[slot].length > (int)*length)
-					DEBUG_CRITICAL3("Received %d bytes but expected only %d",
-						concurrent[slot].length, *length);
-				else
-					*length = concurrent[slot].length;
-				memcpy(buffer, concurrent[slot].buffer, *length);
-				concurrent[slot].length = 0;
+				DEBUG_CRITICAL("malloc failed");
+				*length = 0;
+				return STATUS_UNSUCCESSFUL;
 			}
-			else
-				rv = EINTR;
+			data = allocated;
+			actual_length = size;
 		}
 
-		pthread_mutex_unlock(&concurrent[slot].slot_mutex);
-
-		if (rv)
-			return STATUS_UNSUCCESSFUL;
-	}
-	else
-	{
-		rv = libusb_bulk_transfer(usb_device->dev_handle,
-			usb_device->bulk_in, buffer, *length,
-			&actual_length, usb_device->ccid.readTimeout);
+		rv = submit_bulk_in(usb_device->dev_handle, usb_device,
+			data, actual_length);
+		if (0 == rv)
+		{
+			rv = wait_transfer(read_transfer, timeout);
+			actual_length = read_transfer->transfer->actual_length;
+		}
 
 		if (rv < 0)
 		{
+			free(allocated);
 			*length = 0;
 			DEBUG_CRITICAL4("read failed (%d/%d): %s",
 				usb_device->bus_number,
@@ -1082,29 +1823,70 @@ read_again:
 
 			return STATUS_UNSUCCESSFUL;
 		}
-
-		*length = actual_length;
 	}
 
-	DEBUG_XXD(debug_header, buffer, *length);
+	DEBUG_XXD(debug_header, data, actual_length);
 
-#define BSEQ_OFFSET 6
-	if ((*length >= BSEQ_OFFSET +1)
+	if ((actual_length >= BSEQ_OFFSET +1)
 		&& (bSeq != -1)
-		&& (buffer[BSEQ_OFFSET] != bSeq))
+		&& (data[BSEQ_OFFSET] != bSeq))
 	{
+		if (frame)
+			Multi_PutFrame(usb_device->multislot_extension, frame);
+		frame = NULL;
+		free(allocated);
+		allocated = NULL;
+
 		duplicate_frame++;
 		if (duplicate_frame > 10)
 		{
 			DEBUG_CRITICAL("Too many duplicate frame detected");
+			*length = 0;
+
+			/* the command is abandoned */
+			if (usb_device->multislot_extension)
+				Multi_ReleaseSlot(usb_device->multislot_extension,
+					usb_device->ccid.bCurrentSlotIndex);
 			return STATUS_UNSUCCESSFUL;
 		}
 		DEBUG_INFO1("Invalid frame detected");
 		goto read_again;
 	}
 
+	/* the slot is still busy after a time extension request */
+	if (usb_device->multislot_extension
+		&& !((actual_length > STATUS_OFFSET)
+			&& (data[STATUS_OFFSET] & CCID_TIME_EXTENSION)))
+		Multi_ReleaseSlot(usb_device->multislot_extension,
+			usb_device->ccid.bCurrentSlotIndex);
+
+	if (actual_length > (int)size)
+		DEBUG_CRITICAL3("Received %d bytes but expected only %d",
+			actual_length, size);
+
+	/* scatter the frame in the caller buffers */
+	if (data != iov[0].iov_base)
+	{
+		unsigned int offset = 0;
+
+		for (int i=0; (i<iovcnt) && (offset < (unsigned int)actual_length); i++)
+		{
+			unsigned int n = min(iov[i].iov_len, actual_length - offset);
+
+			memcpy(iov[i].iov_base, data + offset, n);
+			offset += n;
+		}
+	}
+
+	if (frame)
+		Multi_PutFrame(usb_device->multislot_extension, frame);
+	free(allocated);
+
+	/* length of the frame, even if it did not fit in the caller buffers */
+	*length = actual_length;
+
 	return STATUS_SUCCESS;
-} /* ReadUSB */
+} /* ReadvUSB */
 
 
 /*****************************************************************************
@@ -1127,6 +1909,15 @@ status_t CloseUSB(CcidDesc * ccid_reader)
 	/* one slot closed */
 	(*usb_device->nb_opened_slots)--;
 
+	/* a command may still be in progress */
+	if (usb_device->multislot_extension)
+		Multi_ReleaseSlot(usb_device->multislot_extension,
+			usb_device->ccid.bCurrentSlotIndex);
+
+	/* transfer used by this slot only */
+	free_usb_transfer(usb_device->dev_handle, usb_device->write_transfer);
+	usb_device->write_transfer = NULL;
+
 	/* release the allocated resources for the last slot only */
 	if (0 == *usb_device->nb_opened_slots)
 	{
@@ -1146,10 +1937,6 @@ status_t CloseUSB(CcidDesc * ccid_reader)
 			/* wait for the thread to actually terminate */
 			pthread_join(msExt->thread_proc, NULL);
 
-			/* release the shared objects */
-			pthread_cond_destroy(&msExt->condition);
-			pthread_mutex_destroy(&msExt->mutex);
-
 			/* wait for the thread to actually terminate */
 			pthread_join(msExt->thread_concurrent, NULL);
 
@@ -1160,9 +1947,26 @@ status_t CloseUSB(CcidDesc * ccid_reader)
 				/* Create mutex and condition object for the concurrent read */
 				pthread_cond_destroy(&concurrent[slot].slot_condition);
 				pthread_mutex_destroy(&concurrent[slot].slot_mutex);
+				pthread_cond_destroy(&concurrent[slot].interrupt_condition);
+
+				/* frame received but never read */
+				free(concurrent[slot].frame);
 			}
 			free(concurrent);
 
+			/* release the shared objects */
+			pthread_mutex_destroy(&msExt->mutex);
+			pthread_mutex_destroy(&msExt->frames_mutex);
+			pthread_cond_destroy(&msExt->busy_condition);
+			pthread_mutex_destroy(&msExt->busy_mutex);
+			while (msExt->free_frames)
+			{
+				struct multiSlotFrame *frame = msExt->free_frames;
+
+				msExt->free_frames = frame->next;
+				free(frame);
+			}
+
 			/* Deallocate the extension itself */
 			free(msExt);
 
@@ -1204,6 +2008,16 @@ status_t CloseUSB(CcidDesc * ccid_reader)
 		if (usb_device->ccid.arrayOfSupportedDataRates)
 			free(usb_device->ccid.arrayOfSupportedDataRates);
 
+		if (usb_device->ccid.arrayOfSupportedClocks)
+			free(usb_device->ccid.arrayOfSupportedClocks);
+
+		/* transfers shared by all the slots */
+		free_usb_transfer(usb_device->dev_handle, usb_device->read_transfer);
+		free_usb_transfer(usb_device->dev_handle,
+			usb_device->interrupt_transfer);
+		usb_device->read_transfer = NULL;
+		usb_device->interrupt_transfer = NULL;
+
 		(void)libusb_release_interface(usb_device->dev_handle,
 			usb_device->interface);
 		(void)libusb_close(usb_device->dev_handle);
@@ -1502,50 +2316,52 @@ bool ccid_check_firmware(struct libusb_device_descriptor *desc)
 
 /*****************************************************************************
  *
- *					get_data_rates
+ *					get_supported_values
  *
  ****************************************************************************/
-static unsigned int *get_data_rates(CcidDesc * ccid_reader,
-	const unsigned char bNumDataRatesSupported)
+static unsigned int *get_supported_values(CcidDesc * ccid_reader,
+	unsigned char bRequest, const unsigned char bNumSupported)
 {
 	int n, i, len;
 	unsigned char buffer[256*sizeof(int)];	/* maximum is 256 records */
 	unsigned int *uint_array;
+	const char *name = (0x02 == bRequest) ? "CLOCK_FREQUENCIES" : "DATA_RATES";
 
-	if (0 == bNumDataRatesSupported)
+	if (0 == bNumSupported)
 		/* read up to the buffer size */
 		len = sizeof(buffer) / sizeof(int);
 	else
-		len = bNumDataRatesSupported;
+		len = bNumSupported;
 
-	/* See CCID v1.1 ch. 5.3.3 GET_DATA_RATES page 24  */
+	/* See CCID v1.1 ch. 5.3.2 GET_CLOCK_FREQUENCIES and
+	 * ch. 5.3.3 GET_DATA_RATES page 24 */
 	n = ControlUSB(ccid_reader,
 		0xA1, /* request type */
-		0x03, /* GET_DATA_RATES */
+		bRequest,
 		0x00, /* value */
 		buffer, len * sizeof(int));
 
 	/* we got an error? */
 	if (n <= 0)
 	{
-		DEBUG_INFO2("IFD does not support GET_DATA_RATES request: %d", n);
+		DEBUG_INFO3("IFD does not support GET_%s request: %d", name, n);
 		return NULL;
 	}
 
 	/* we got a strange value */
 	if (n % 4)
 	{
-		DEBUG_INFO2("Wrong GET DATA RATES size: %d", n);
+		DEBUG_INFO3("Wrong GET %s size: %d", name, n);
 		return NULL;
 	}
 
 	/* allocate the buffer (including the end marker) */
 	n /= sizeof(int);
 
-	/* we do not get the expected number of data rates */
-	if ((n != bNumDataRatesSupported) && bNumDataRatesSupported)
+	/* we do not get the expected number of values */
+	if ((n != bNumSupported) && bNumSupported)
 	{
-		DEBUG_INFO3("Got %d data rates but was expecting %d", n, len);
+		DEBUG_INFO4("Got %d %s but was expecting %d", n, name, len);
 
 		/* we got more data than expected */
 		if (n > len)
@@ -1563,14 +2379,15 @@ static unsigned int *get_data_rates(CcidDesc * ccid_reader,
 	for (i=0; i<n; i++)
 	{
 		uint_array[i] = dw2i(buffer, i*4);
-		DEBUG_INFO2("declared: %d bps", uint_array[i]);
+		DEBUG_INFO3("declared: %d %s", uint_array[i],
+			(0x02 == bRequest) ? "kHz" : "bps");
 	}
 
 	/* end of array marker */
 	uint_array[i] = 0;
 
 	return uint_array;
-} /* get_data_rates */
+} /* get_supported_values */
 
 
 /*****************************************************************************
@@ -1608,6 +2425,95 @@ int ControlUSB(CcidDesc * ccid_reader, int requesttype, int request,
 	return ret;
 } /* ControlUSB */
 
+/*****************************************************************************
+ *
+ *					alloc_usb_transfer
+ *
+ ****************************************************************************/
+static struct usbTransfer *alloc_usb_transfer(libusb_device_handle *dev_handle,
+	int length)
+{
+	struct usbTransfer *usb_transfer;
+
+	usb_transfer = calloc(1, sizeof(struct usbTransfer));
+	if (NULL == usb_transfer)
+		return NULL;
+
+	usb_transfer->transfer = libusb_alloc_transfer(0);
+	if (NULL == usb_transfer->transfer)
+	{
+		free(usb_transfer);
+		return NULL;
+	}
+
+	/* completion object signaled by the event thread */
+	pthread_mutex_init(&usb_transfer->mutex, NULL);
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	pthread_condattr_t condattr;
+
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&usb_transfer->condition, &condattr);
+	pthread_condattr_destroy(&condattr);
+#else
+	pthread_cond_init(&usb_transfer->condition, NULL);
+#endif
+
+	if (length <= 0)
+		return usb_transfer;
+
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+	/* DMA capable memory, if supported by the kernel */
+	usb_transfer->buffer = libusb_dev_mem_alloc(dev_handle, length);
+	if (usb_transfer->buffer)
+		usb_transfer->dev_mem = true;
+#else
+	(void)dev_handle;
+#endif
+
+	if (NULL == usb_transfer->buffer)
+	{
+		usb_transfer->buffer = malloc(length);
+		if (NULL == usb_transfer->buffer)
+		{
+			free_usb_transfer(dev_handle, usb_transfer);
+			return NULL;
+		}
+	}
+
+	if (usb_transfer->buffer)
+		usb_transfer->length = length;
+
+	return usb_transfer;
+} /* alloc_usb_transfer */
+
+/*****************************************************************************
+ *
+ *					free_usb_transfer
+ *
+ ****************************************************************************/
+static void free_usb_transfer(libusb_device_handle *dev_handle,
+	struct usbTransfer *usb_transfer)
+{
+	if (NULL == usb_transfer)
+		return;
+
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+	if (usb_transfer->dev_mem)
+		(void)libusb_dev_mem_free(dev_handle, usb_transfer->buffer,
+			usb_transfer->length);
+	else
+#else
+	(void)dev_handle;
+#endif
+		free(usb_transfer->buffer);
+
+	pthread_cond_destroy(&usb_transfer->condition);
+	pthread_mutex_destroy(&usb_transfer->mutex);
+	libusb_free_transfer(usb_transfer->transfer);
+	free(usb_transfer);
+} /* free_usb_transfer */
+
 /*****************************************************************************
  *
  *					Transfer is complete
@@ -1615,11 +2521,175 @@ int ControlUSB(CcidDesc * ccid_reader, int requesttype, int request,
  ****************************************************************************/
 static void bulk_transfer_cb(struct libusb_transfer *transfer)
 {
-	int *completed = transfer->user_data;
-	*completed = 1;
-	/* caller interprets results and frees transfer */
+	struct usbTransfer *usb_transfer = transfer->user_data;
+
+	/* called by the event thread: wake up the waiting thread */
+	pthread_mutex_lock(&usb_transfer->mutex);
+	usb_transfer->completed = 1;
+	pthread_cond_broadcast(&usb_transfer->condition);
+	pthread_mutex_unlock(&usb_transfer->mutex);
+	/* caller interprets results */
 }
 
+/*****************************************************************************
+ *
+ *					transfer_status_to_error
+ *
+ ****************************************************************************/
+static int transfer_status_to_error(enum libusb_transfer_status status)
+{
+	/* same mapping as the libusb synchronous API */
+	switch (status)
+	{
+		case LIBUSB_TRANSFER_COMPLETED:
+			return LIBUSB_SUCCESS;
+
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			return LIBUSB_ERROR_TIMEOUT;
+
+		case LIBUSB_TRANSFER_STALL:
+			return LIBUSB_ERROR_PIPE;
+
+		case LIBUSB_TRANSFER_OVERFLOW:
+			return LIBUSB_ERROR_OVERFLOW;
+
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			return LIBUSB_ERROR_NO_DEVICE;
+
+		case LIBUSB_TRANSFER_CANCELLED:
+			return LIBUSB_ERROR_INTERRUPTED;
+
+		default:
+			return LIBUSB_ERROR_IO;
+	}
+} /* transfer_status_to_error */
+
+/*****************************************************************************
+ *
+ *					iov_contiguous
+ *
+ ****************************************************************************/
+static bool iov_contiguous(const struct iovec *iov, int iovcnt)
+{
+	/* each vector follows the previous one in memory */
+	for (int i=1; i<iovcnt; i++)
+		if ((unsigned char *)iov[i-1].iov_base + iov[i-1].iov_len
+			!= iov[i].iov_base)
+			return false;
+
+	return true;
+} /* iov_contiguous */
+
+/*****************************************************************************
+ *
+ *					submit_bulk_in
+ *
+ ****************************************************************************/
+static int submit_bulk_in(libusb_device_handle *dev_handle,
+	_usbDevice *usb_device, unsigned char *buffer, int length)
+{
+	struct usbTransfer *read_transfer = usb_device->read_transfer;
+
+	/* no libusb timeout: the timeout is handled by the caller since the
+	 * transfer may be submitted long before the response is expected */
+	read_transfer->completed = 0;
+	read_transfer->aborted = false;
+	libusb_fill_bulk_transfer(read_transfer->transfer,
+		dev_handle, usb_device->bulk_in, buffer, length,
+		bulk_transfer_cb, read_transfer, 0);
+
+	return libusb_submit_transfer(read_transfer->transfer);
+} /* submit_bulk_in */
+
+/*****************************************************************************
+ *
+ *					cancel_transfer
+ *
+ ****************************************************************************/
+static void cancel_transfer(struct usbTransfer *usb_transfer)
+{
+	(void)libusb_cancel_transfer(usb_transfer->transfer);
+
+	/* the transfer can only be reused once the callback has been called */
+	pthread_mutex_lock(&usb_transfer->mutex);
+	while (! usb_transfer->completed)
+		pthread_cond_wait(&usb_transfer->condition, &usb_transfer->mutex);
+	pthread_mutex_unlock(&usb_transfer->mutex);
+} /* cancel_transfer */
+
+/*****************************************************************************
+ *
+ *					abort_transfer
+ *
+ ****************************************************************************/
+static void abort_transfer(struct usbTransfer *usb_transfer)
+{
+	/* wake up the thread blocked in wait_transfer(). The transfer itself
+	 * is cancelled by this thread */
+	pthread_mutex_lock(&usb_transfer->mutex);
+	usb_transfer->aborted = true;
+	pthread_cond_broadcast(&usb_transfer->condition);
+	pthread_mutex_unlock(&usb_transfer->mutex);
+} /* abort_transfer */
+
+/*****************************************************************************
+ *
+ *					wait_transfer
+ *
+ ****************************************************************************/
+static int wait_transfer(struct usbTransfer *usb_transfer,
+	unsigned int timeout /* in ms, 0 for no timeout */)
+{
+	struct timespec deadline;
+	int rv = 0;
+
+	if (timeout)
+	{
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+		clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000 * 1000;
+		if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000 * 1000 * 1000;
+		}
+	}
+
+	pthread_mutex_lock(&usb_transfer->mutex);
+	while (! usb_transfer->completed && (0 == rv))
+	{
+		if (usb_transfer->aborted)
+			rv = ECANCELED;
+		else if (timeout)
+			rv = pthread_cond_timedwait(&usb_transfer->condition,
+				&usb_transfer->mutex, &deadline);
+		else
+			rv = pthread_cond_wait(&usb_transfer->condition,
+				&usb_transfer->mutex);
+	}
+	pthread_mutex_unlock(&usb_transfer->mutex);
+
+	if (rv)
+	{
+		cancel_transfer(usb_transfer);
+
+		/* the transfer may have completed in the meantime */
+		if (LIBUSB_TRANSFER_COMPLETED == usb_transfer->transfer->status)
+			return LIBUSB_SUCCESS;
+
+		if (ECANCELED == rv)
+			return LIBUSB_ERROR_INTERRUPTED;
+
+		return LIBUSB_ERROR_TIMEOUT;
+	}
+
+	return transfer_status_to_error(usb_transfer->transfer->status);
+} /* wait_transfer */
+
 /*****************************************************************************
  *
  *					InterruptRead
@@ -1629,9 +2699,9 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 {
 	int ret, actual_length;
 	int return_value = IFD_SUCCESS;
-	unsigned char buffer[8];
+	unsigned char *buffer;
 	struct libusb_transfer *transfer;
-	int completed = 0;
+	struct usbTransfer *interrupt_transfer;
 	_usbDevice * usb_device = &ccid_reader->device;
 
 	/* Multislot reader: redirect to Multi_InterrupRead */
@@ -1646,20 +2716,23 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 
 	DEBUG_PERIODIC3("before (%X), timeout: %d ms", ccid_reader->lun, timeout);
 
-	transfer = libusb_alloc_transfer(0);
-	if (NULL == transfer)
-		return LIBUSB_ERROR_NO_MEM;
+	interrupt_transfer = usb_device->interrupt_transfer;
+	transfer = interrupt_transfer->transfer;
+	buffer = interrupt_transfer->buffer;
 
+	interrupt_transfer->completed = 0;
 	libusb_fill_interrupt_transfer(transfer,
 		usb_device->dev_handle,
-		usb_device->interrupt, buffer, sizeof(buffer),
-		bulk_transfer_cb, &completed, timeout);
+		usb_device->interrupt, buffer, CCID_INTERRUPT_SIZE,
+		bulk_transfer_cb, interrupt_transfer, timeout);
 
 	ret = libusb_submit_transfer(transfer);
 	if (ret < 0) {
-		libusb_free_transfer(transfer);
 		DEBUG_CRITICAL2("libusb_submit_transfer failed: %s",
 			libusb_error_name(ret));
+		pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+		usb_device->presence.state = PRESENCE_UNTRACKED;
+		pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
 		if (LIBUSB_ERROR_NO_DEVICE == ret)
 			return IFD_NO_SUCH_DEVICE;
 		return IFD_COMMUNICATION_ERROR;
@@ -1678,23 +2751,8 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 		libusb_cancel_transfer(transfer);
 	}
 
-	while (!completed)
-	{
-		ret = libusb_handle_events_completed(ctx, &completed);
-		if (ret < 0)
-		{
-			if (ret == LIBUSB_ERROR_INTERRUPTED)
-				continue;
-			libusb_cancel_transfer(transfer);
-			while (!completed)
-				if (libusb_handle_events_completed(ctx, &completed) < 0)
-					break;
-			libusb_free_transfer(transfer);
-			DEBUG_CRITICAL2("libusb_handle_events failed: %s",
-				libusb_error_name(ret));
-			return IFD_COMMUNICATION_ERROR;
-		}
-	}
+	/* the libusb timeout is used. The transfer status is checked below */
+	(void)wait_transfer(interrupt_transfer, 0);
 
 	actual_length = transfer->actual_length;
 	ret = transfer->status;
@@ -1702,10 +2760,21 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
 	usb_device->polling_transfer = NULL;
 	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
-	libusb_free_transfer(transfer);
 
 	DEBUG_PERIODIC3("after (%X) (%d)", ccid_reader->lun, ret);
 
+	/* the card movements are notified as long as the interrupt endpoint
+	 * is polled */
+	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+	if ((LIBUSB_TRANSFER_COMPLETED == ret) || (LIBUSB_TRANSFER_TIMED_OUT == ret))
+	{
+		if (PRESENCE_UNTRACKED == usb_device->presence.state)
+			usb_device->presence.state = PRESENCE_UNKNOWN;
+	}
+	else
+		usb_device->presence.state = PRESENCE_UNTRACKED;
+	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
+
 	switch (ret)
 	{
 		case LIBUSB_TRANSFER_COMPLETED:
@@ -1715,9 +2784,16 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 				{
 					case RDR_to_PC_NotifySlotChange:
 						DEBUG_XXD("NotifySlotChange: ", buffer, actual_length);
+						pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+						update_presence(&usb_device->presence, buffer,
+							actual_length, usb_device->ccid.bCurrentSlotIndex);
+						pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
 						break;
 					case RDR_to_PC_HardwareError:
 						DEBUG_XXD("HardwareError: ", buffer, actual_length);
+						pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+						update_presence(&usb_device->presence, NULL, 0, 0);
+						pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
 						break;
 					default:
 						DEBUG_XXD("Unrecognized notification: ", buffer, actual_length);
@@ -1730,55 +2806,189 @@ int InterruptRead(CcidDesc *ccid_reader, int timeout /* in ms */)
 		case LIBUSB_TRANSFER_CANCELLED:
 			break;
 
-		case LIBUSB_TRANSFER_NO_DEVICE:
-			return_value = IFD_NO_SUCH_DEVICE;
-			break;
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			return_value = IFD_NO_SUCH_DEVICE;
+			break;
+
+		default:
+			/* if libusb_interrupt_transfer() times out we get EILSEQ or EAGAIN */
+			DEBUG_COMM4("InterruptRead (%d/%d): %s",
+				usb_device->bus_number,
+				usb_device->device_address,
+				libusb_error_name(ret));
+			return_value = IFD_COMMUNICATION_ERROR;
+	}
+
+	return return_value;
+} /* InterruptRead */
+
+
+/*****************************************************************************
+ *
+ *					Stop the async loop
+ *
+ ****************************************************************************/
+void InterruptStop(CcidDesc * ccid_reader)
+{
+	_usbDevice * usb_device = &ccid_reader->device;
+
+	/* Multislot reader: redirect to Multi_InterrupStop */
+	if (usb_device->multislot_extension != NULL)
+	{
+		Multi_InterruptStop(ccid_reader);
+		return;
+	}
+
+	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+	if (usb_device->polling_transfer)
+	{
+		int ret;
+
+		ret = libusb_cancel_transfer(usb_device->polling_transfer);
+		if (ret < 0)
+			DEBUG_CRITICAL2("libusb_cancel_transfer failed: %s",
+				libusb_error_name(ret));
+	} else {
+		// Indicate that the next attempt to start an interrupt transfer shouldn't
+		// be proceeded.
+		usb_device->terminate_requested = true;
+	}
+	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
+
+	/* do not leave a command waiting for its response. CCID_Receive()
+	 * then aborts the command in the reader */
+	abort_transfer(usb_device->read_transfer);
+} /* InterruptStop */
+
+
+/*****************************************************************************
+ *
+ *					InterruptGetPresence
+ *
+ ****************************************************************************/
+int InterruptGetPresence(CcidDesc * ccid_reader, unsigned int *events)
+{
+	/*
+	 * Returns IFD_ICC_PRESENT or IFD_ICC_NOT_PRESENT if the card presence
+	 * is known from the interrupt endpoint notifications.
+	 * Otherwise returns -1 and the number of notifications received to
+	 * be given to InterruptSetPresence()
+	 */
+	_usbDevice * usb_device = &ccid_reader->device;
+	struct usbDevice_MultiSlot_Extension *msExt = usb_device->multislot_extension;
+	pthread_mutex_t *mutex;
+	struct slotPresence *presence;
+	int state;
+
+	if (msExt)
+	{
+		if (msExt->terminated)
+			return -1;
+
+		mutex = &msExt->mutex;
+		presence = &msExt->concurrent[(int)usb_device->ccid.bCurrentSlotIndex].presence;
+	}
+	else
+	{
+		mutex = &usb_device->polling_transfer_mutex;
+		presence = &usb_device->presence;
+	}
+
+	pthread_mutex_lock(mutex);
+	state = presence->state;
+	*events = presence->events;
+	pthread_mutex_unlock(mutex);
+
+	switch (state)
+	{
+		case PRESENCE_PRESENT:
+			return IFD_ICC_PRESENT;
+
+		case PRESENCE_ABSENT:
+			return IFD_ICC_NOT_PRESENT;
 
 		default:
-			/* if libusb_interrupt_transfer() times out we get EILSEQ or EAGAIN */
-			DEBUG_COMM4("InterruptRead (%d/%d): %s",
-				usb_device->bus_number,
-				usb_device->device_address,
-				libusb_error_name(ret));
-			return_value = IFD_COMMUNICATION_ERROR;
+			return -1;
 	}
-
-	return return_value;
-} /* InterruptRead */
+} /* InterruptGetPresence */
 
 
 /*****************************************************************************
  *
- *					Stop the async loop
+ *					InterruptSetPresence
  *
  ****************************************************************************/
-void InterruptStop(CcidDesc * ccid_reader)
+void InterruptSetPresence(CcidDesc * ccid_reader, unsigned int events,
+	int presence)
 {
+	/*
+	 * Store the card presence got from a PC_to_RDR_GetSlotStatus.
+	 * The next card movements will be notified by the interrupt endpoint.
+	 * Ignored if the interrupt endpoint is not polled or if a
+	 * notification has been received in the meantime.
+	 */
 	_usbDevice * usb_device = &ccid_reader->device;
+	struct usbDevice_MultiSlot_Extension *msExt = usb_device->multislot_extension;
+	pthread_mutex_t *mutex;
+	struct slotPresence *slot_presence;
 
-	/* Multislot reader: redirect to Multi_InterrupStop */
-	if (usb_device->multislot_extension != NULL)
+	if (msExt)
 	{
-		Multi_InterruptStop(ccid_reader);
-		return;
+		mutex = &msExt->mutex;
+		slot_presence = &msExt->concurrent[(int)usb_device->ccid.bCurrentSlotIndex].presence;
 	}
-
-	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
-	if (usb_device->polling_transfer)
+	else
 	{
-		int ret;
+		mutex = &usb_device->polling_transfer_mutex;
+		slot_presence = &usb_device->presence;
+	}
 
-		ret = libusb_cancel_transfer(usb_device->polling_transfer);
-		if (ret < 0)
-			DEBUG_CRITICAL2("libusb_cancel_transfer failed: %s",
-				libusb_error_name(ret));
-	} else {
-		// Indicate that the next attempt to start an interrupt transfer shouldn't
-		// be proceeded.
-		usb_device->terminate_requested = true;
+	pthread_mutex_lock(mutex);
+	if ((slot_presence->state != PRESENCE_UNTRACKED)
+		&& (slot_presence->events == events))
+		slot_presence->state = (IFD_ICC_PRESENT == presence) ?
+			PRESENCE_PRESENT : PRESENCE_ABSENT;
+	pthread_mutex_unlock(mutex);
+} /* InterruptSetPresence */
+
+
+/*****************************************************************************
+ *
+ *					update_presence
+ *
+ ****************************************************************************/
+static void update_presence(struct slotPresence *presence,
+	/*@null@*/ const unsigned char *notify_slot_change, int length, int slot)
+{
+	/* 2 bits per slot: card present and status changed */
+	int interrupt_byte = (slot / 4) + 1;
+	int bits;
+
+	presence->events++;
+
+	if (PRESENCE_UNTRACKED == presence->state)
+		return;
+
+	/* not a RDR_to_PC_NotifySlotChange or slot not reported */
+	if ((NULL == notify_slot_change) || (interrupt_byte >= length))
+	{
+		presence->state = PRESENCE_UNKNOWN;
+		return;
 	}
-	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
-} /* InterruptStop */
+
+	bits = (notify_slot_change[interrupt_byte] >> (2 * (slot % 4))) & 0x03;
+
+	if (0 == (bits & 0x01))
+		presence->state = PRESENCE_ABSENT;
+	else
+		/* a card inserted in an empty slot is a new card. Otherwise the
+		 * card may have been replaced and PC_to_RDR_GetSlotStatus is
+		 * used to check it */
+		if ((bits & 0x02) && (presence->state != PRESENCE_ABSENT))
+			presence->state = PRESENCE_UNKNOWN;
+		else
+			presence->state = PRESENCE_PRESENT;
+} /* update_presence */
 
 
 /*****************************************************************************
@@ -1790,21 +3000,18 @@ static void *Multi_PollingProc(void *p_ext)
 {
 	struct usbDevice_MultiSlot_Extension *msExt = p_ext;
 	int rv, status, actual_length;
-	unsigned char buffer[CCID_INTERRUPT_SIZE];
+	unsigned char *buffer;
 	struct libusb_transfer *transfer;
-	int completed;
+	struct usbTransfer *interrupt_transfer;
 	_usbDevice * usb_device = &msExt->ccid_reader->device;
 
 	DEBUG_COMM3("Multi_PollingProc (%d/%d): thread starting",
 		usb_device->bus_number,
 		usb_device->device_address);
 
-	transfer = libusb_alloc_transfer(0);
-	if (NULL == transfer)
-	{
-		DEBUG_COMM("libusb_alloc_transfer error");
-		goto end;
-	}
+	interrupt_transfer = usb_device->interrupt_transfer;
+	transfer = interrupt_transfer->transfer;
+	buffer = interrupt_transfer->buffer;
 
 	rv = 0;
 	while (!msExt->terminated)
@@ -1813,12 +3020,12 @@ static void *Multi_PollingProc(void *p_ext)
 			usb_device->bus_number,
 			usb_device->device_address);
 
-		completed = 0;
+		interrupt_transfer->completed = 0;
 		libusb_fill_interrupt_transfer(transfer,
 			msExt->dev_handle,
 			usb_device->interrupt,
 			buffer, CCID_INTERRUPT_SIZE,
-			bulk_transfer_cb, &completed, 0); /* No timeout ! */
+			bulk_transfer_cb, interrupt_transfer, 0); /* No timeout ! */
 
 		rv = libusb_submit_transfer(transfer);
 		if (rv)
@@ -1830,30 +3037,14 @@ static void *Multi_PollingProc(void *p_ext)
 
 		pthread_mutex_lock(&usb_device->polling_transfer_mutex);
 		usb_device->polling_transfer = transfer;
+		/* Multi_PollingTerminate() may have been called before
+		 * polling_transfer was set */
+		if (msExt->terminated)
+			libusb_cancel_transfer(transfer);
 		pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
 
-		while (!completed && !msExt->terminated)
-		{
-			rv = libusb_handle_events_completed(ctx, &completed);
-			if (rv < 0)
-			{
-				DEBUG_COMM2("libusb_handle_events err %s",
-					libusb_error_name(rv));
-
-				if (rv == LIBUSB_ERROR_INTERRUPTED)
-					continue;
-
-				libusb_cancel_transfer(transfer);
-
-				while (!completed && !msExt->terminated)
-				{
-					if (libusb_handle_events_completed(ctx, &completed) < 0)
-						break;
-				}
-
-				break;
-			}
-		}
+		/* the transfer status is checked below */
+		(void)wait_transfer(interrupt_transfer, 0);
 
 		pthread_mutex_lock(&usb_device->polling_transfer_mutex);
 		usb_device->polling_transfer = NULL;
@@ -1929,27 +3120,21 @@ static void *Multi_PollingProc(void *p_ext)
 						libusb_error_name(status));
 			}
 
-			/* Tell other slots that there's a new interrupt buffer */
-			DEBUG_COMM3("Multi_PollingProc (%d/%d): Broadcast to slot(s)",
+			/* Tell the slots that there's a new interrupt */
+			DEBUG_COMM3("Multi_PollingProc (%d/%d): Signal slot(s)",
 				usb_device->bus_number,
 				usb_device->device_address);
 
-			/* Lock the mutex */
-			pthread_mutex_lock(&msExt->mutex);
-
-			/* Set the status and the interrupt buffer */
-			msExt->status = status;
-			memset(msExt->buffer, 0, sizeof msExt->buffer);
-			memcpy(msExt->buffer, buffer, actual_length);
-
-			/* Broadcast the condition and unlock */
-			pthread_cond_broadcast(&msExt->condition);
-			pthread_mutex_unlock(&msExt->mutex);
+			/* only the slots with a changed status for a
+			 * RDR_to_PC_NotifySlotChange */
+			if ((LIBUSB_TRANSFER_COMPLETED == status) && (actual_length > 0)
+				&& (RDR_to_PC_NotifySlotChange == buffer[0]))
+				Multi_SignalSlots(msExt, status, buffer, actual_length);
+			else
+				Multi_SignalSlots(msExt, status, NULL, 0);
 		}
 	}
 
-	libusb_free_transfer(transfer);
-
 	if (rv < 0)
 	{
 		if	(rv != LIBUSB_ERROR_NO_DEVICE)
@@ -1964,22 +3149,15 @@ static void *Multi_PollingProc(void *p_ext)
 				libusb_error_name(rv));
 	}
 
-	/* Wake up the slot threads so they will exit as well */
-
-	/* Lock the mutex */
+	/* the card movements are no more notified */
 	pthread_mutex_lock(&msExt->mutex);
-
-	/* Set the status and fill-in the interrupt buffer */
-	msExt->status = 0;
-	memset(msExt->buffer, 0xFF, sizeof msExt->buffer);
-
-	/* Broadcast the condition */
-	pthread_cond_broadcast(&msExt->condition);
-
-	/* Unlock */
+	for (int slot=0; slot<=usb_device->ccid.bMaxSlotIndex; slot++)
+		msExt->concurrent[slot].presence.state = PRESENCE_UNTRACKED;
 	pthread_mutex_unlock(&msExt->mutex);
 
-end:
+	/* Wake up the slot threads so they will exit as well */
+	Multi_SignalSlots(msExt, 0, NULL, 0);
+
 	/* Now exit */
 	DEBUG_COMM3("Multi_PollingProc (%d/%d): Thread terminated",
 		usb_device->bus_number,
@@ -1990,6 +3168,44 @@ end:
 } /* Multi_PollingProc */
 
 
+/*****************************************************************************
+ *
+ *					Multi_SignalSlots
+ *
+ ****************************************************************************/
+static void Multi_SignalSlots(struct usbDevice_MultiSlot_Extension *msExt,
+	int status, /*@null@*/ const unsigned char *notify_slot_change,
+	int length)
+{
+	struct multiSlot_ConcurrentAccess *concurrent = msExt->concurrent;
+	int bMaxSlotIndex = msExt->ccid_reader->device.ccid.bMaxSlotIndex;
+
+	pthread_mutex_lock(&msExt->mutex);
+
+	for (int slot=0; slot<=bMaxSlotIndex; slot++)
+	{
+		/* 2 bits per slot. The "status changed" bit is the second one */
+		int interrupt_byte = (slot / 4) + 1;
+		int interrupt_mask = 0x02 << (2 * (slot % 4));
+
+		/* a timeout does not change the card presence */
+		if (notify_slot_change || (status != LIBUSB_TRANSFER_TIMED_OUT))
+			update_presence(&concurrent[slot].presence, notify_slot_change,
+				length, slot);
+
+		if (notify_slot_change && ((interrupt_byte >= length)
+			|| (0 == (notify_slot_change[interrupt_byte] & interrupt_mask))))
+			continue;
+
+		concurrent[slot].interrupt = true;
+		concurrent[slot].interrupt_status = status;
+		pthread_cond_signal(&concurrent[slot].interrupt_condition);
+	}
+
+	pthread_mutex_unlock(&msExt->mutex);
+} /* Multi_SignalSlots */
+
+
 /*****************************************************************************
  *
  *					Multi_PollingTerminate
@@ -2013,6 +3229,10 @@ static void Multi_PollingTerminate(struct usbDevice_MultiSlot_Extension *msExt)
 				DEBUG_CRITICAL2("libusb_cancel_transfer failed: %d", ret);
 		}
 
+		/* also stop Multi_ReadProc() */
+		if (msExt->read_submitted)
+			(void)libusb_cancel_transfer(usb_device->read_transfer->transfer);
+
 		pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
 	}
 } /* Multi_PollingTerminate */
@@ -2026,9 +3246,9 @@ static void Multi_PollingTerminate(struct usbDevice_MultiSlot_Extension *msExt)
 static int Multi_InterruptRead(CcidDesc * ccid_reader, int timeout /* in ms */)
 {
 	struct usbDevice_MultiSlot_Extension *msExt;
-	unsigned char buffer[CCID_INTERRUPT_SIZE];
+	struct multiSlot_ConcurrentAccess *concurrent;
 	struct timespec cond_wait_until;
-	int rv, status, interrupt_byte, interrupt_mask;
+	int rv, status, slot;
 
 	msExt = ccid_reader->device.multislot_extension;
 
@@ -2039,9 +3259,9 @@ static int Multi_InterruptRead(CcidDesc * ccid_reader, int timeout /* in ms */)
 	DEBUG_PERIODIC3("Multi_InterruptRead (%X), timeout: %d ms",
 		ccid_reader->lun, timeout);
 
-	/* Select the relevant bit in the interrupt buffer */
-	interrupt_byte = (ccid_reader->device.ccid.bCurrentSlotIndex / 4) + 1;
-	interrupt_mask = 0x02 << (2 * (ccid_reader->device.ccid.bCurrentSlotIndex % 4));
+	/* event object of the slot */
+	slot = ccid_reader->device.ccid.bCurrentSlotIndex;
+	concurrent = &msExt->concurrent[slot];
 
 	/* Wait until the condition is signaled or a timeout occurs */
 #ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
@@ -2051,24 +3271,31 @@ static int Multi_InterruptRead(CcidDesc * ccid_reader, int timeout /* in ms */)
 #endif
 	cond_wait_until.tv_sec += timeout / 1000;
 	cond_wait_until.tv_nsec += 1000000 * (timeout % 1000);
+	if (cond_wait_until.tv_nsec >= 1000000000)
+	{
+		cond_wait_until.tv_sec++;
+		cond_wait_until.tv_nsec -= 1000000000;
+	}
 
-again:
 	pthread_mutex_lock(&msExt->mutex);
 
-	rv = pthread_cond_timedwait(&msExt->condition, &msExt->mutex,
-		&cond_wait_until);
+	/* Multi_PollingProc() only wakes up the slots concerned by the
+	 * interrupt */
+	concurrent->interrupt = false;
+	rv = 0;
+	while (!concurrent->interrupt && !msExt->terminated && (0 == rv))
+		rv = pthread_cond_timedwait(&concurrent->interrupt_condition,
+			&msExt->mutex, &cond_wait_until);
 
-	if (0 == rv)
-	{
-		/* Retrieve interrupt buffer and request result */
-		memcpy(buffer, msExt->buffer, sizeof buffer);
-		status = msExt->status;
-	}
+	if (concurrent->interrupt)
+		/* Retrieve the request result */
+		status = concurrent->interrupt_status;
 	else
 		if (rv == ETIMEDOUT)
 			status = LIBUSB_TRANSFER_TIMED_OUT;
 		else
 			status = -1;
+	concurrent->interrupt = false;
 
 	/* Don't forget to unlock the mutex */
 	pthread_mutex_unlock(&msExt->mutex);
@@ -2080,13 +3307,6 @@ again:
 	/* Not stopped */
 	if (status == LIBUSB_TRANSFER_COMPLETED)
 	{
-		if (buffer[0] == RDR_to_PC_NotifySlotChange
-			&& 0 == (buffer[interrupt_byte] & interrupt_mask))
-		{
-			DEBUG_PERIODIC2("Multi_InterruptRead (%X) -- skipped",
-				ccid_reader->lun);
-			goto again;
-		}
 		DEBUG_PERIODIC2("Multi_InterruptRead (%X), got an interrupt",
 			ccid_reader->lun);
 	}
@@ -2108,7 +3328,8 @@ again:
 static void Multi_InterruptStop(CcidDesc * ccid_reader)
 {
 	struct usbDevice_MultiSlot_Extension *msExt;
-	int interrupt_byte, interrupt_mask;
+	struct multiSlot_ConcurrentAccess *concurrent;
+	int slot;
 
 	msExt = ccid_reader->device.multislot_extension;
 
@@ -2118,19 +3339,247 @@ static void Multi_InterruptStop(CcidDesc * ccid_reader)
 
 	DEBUG_PERIODIC2("Stop (%X)", ccid_reader->lun);
 
-	interrupt_byte = (ccid_reader->device.ccid.bCurrentSlotIndex / 4) + 1;
-	interrupt_mask = 0x02 << (2 * (ccid_reader->device.ccid.bCurrentSlotIndex % 4));
+	slot = ccid_reader->device.ccid.bCurrentSlotIndex;
+	concurrent = &msExt->concurrent[slot];
 
 	pthread_mutex_lock(&msExt->mutex);
 
-	/* Broadcast an interrupt to wake-up the slot's thread */
-	msExt->buffer[interrupt_byte] |= interrupt_mask;
-	pthread_cond_broadcast(&msExt->condition);
+	/* Signal an interrupt to wake-up the slot's thread */
+	concurrent->interrupt = true;
+	concurrent->interrupt_status = LIBUSB_TRANSFER_COMPLETED;
+	pthread_cond_signal(&concurrent->interrupt_condition);
 
 	pthread_mutex_unlock(&msExt->mutex);
+
+	/* wake up a command waiting for its response. Without a frame
+	 * ReadvUSB() fails and CCID_Receive() aborts the command */
+	pthread_mutex_lock(&concurrent->slot_mutex);
+	pthread_cond_broadcast(&concurrent->slot_condition);
+	pthread_mutex_unlock(&concurrent->slot_mutex);
 } /* Multi_InterruptStop */
 
 
+/*****************************************************************************
+ *
+ *					Multi_AcquireSlot
+ *
+ ****************************************************************************/
+static int Multi_AcquireSlot(struct usbDevice_MultiSlot_Extension *msExt,
+	int slot, unsigned char bSeq, unsigned int timeout)
+{
+	struct multiSlot_ConcurrentAccess *concurrent = &msExt->concurrent[slot];
+	struct timespec deadline;
+	int rv = 0;
+
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	deadline_init(&deadline, timeout);
+#else
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline_extend(&deadline, timeout);
+#endif
+
+	pthread_mutex_lock(&msExt->busy_mutex);
+	if (! concurrent->busy)
+	{
+		while ((msExt->busy_slots >= msExt->max_busy_slots)
+			&& !msExt->terminated && (0 == rv))
+		{
+			DEBUG_COMM3("Slot %d waits: %d busy slots", slot,
+				msExt->busy_slots);
+			rv = pthread_cond_timedwait(&msExt->busy_condition,
+				&msExt->busy_mutex, &deadline);
+		}
+
+		/* a slot may have been released just before the timeout */
+		if (msExt->busy_slots < msExt->max_busy_slots)
+			rv = 0;
+
+		if (0 == rv)
+		{
+			msExt->busy_slots++;
+			concurrent->busy = true;
+		}
+	}
+	pthread_mutex_unlock(&msExt->busy_mutex);
+
+	if (rv)
+	{
+		DEBUG_CRITICAL3("Slot %d: no free slot after %d ms", slot, timeout);
+		return rv;
+	}
+
+	/* used by Multi_ReadProc() to match the response */
+	pthread_mutex_lock(&concurrent->slot_mutex);
+	concurrent->bSeq = bSeq;
+	pthread_mutex_unlock(&concurrent->slot_mutex);
+
+	return 0;
+} /* Multi_AcquireSlot */
+
+
+/*****************************************************************************
+ *
+ *					Multi_ReleaseSlot
+ *
+ ****************************************************************************/
+static void Multi_ReleaseSlot(struct usbDevice_MultiSlot_Extension *msExt,
+	int slot)
+{
+	struct multiSlot_ConcurrentAccess *concurrent = &msExt->concurrent[slot];
+
+	pthread_mutex_lock(&msExt->busy_mutex);
+	if (concurrent->busy)
+	{
+		concurrent->busy = false;
+		msExt->busy_slots--;
+		pthread_cond_signal(&msExt->busy_condition);
+	}
+	pthread_mutex_unlock(&msExt->busy_mutex);
+} /* Multi_ReleaseSlot */
+
+
+/*****************************************************************************
+ *
+ *					Multi_GetFrame
+ *
+ ****************************************************************************/
+static struct multiSlotFrame *Multi_GetFrame(
+	struct usbDevice_MultiSlot_Extension *msExt, int size)
+{
+	struct multiSlotFrame *frame = NULL;
+
+	if (size <= msExt->frame_size)
+	{
+		/* reuse a frame if possible */
+		pthread_mutex_lock(&msExt->frames_mutex);
+		frame = msExt->free_frames;
+		if (frame)
+			msExt->free_frames = frame->next;
+		pthread_mutex_unlock(&msExt->frames_mutex);
+
+		size = msExt->frame_size;
+	}
+
+	/* frames are allocated only when needed */
+	if (NULL == frame)
+	{
+		frame = malloc(sizeof(struct multiSlotFrame) + size);
+		if (NULL == frame)
+		{
+			DEBUG_CRITICAL("malloc failed");
+			return NULL;
+		}
+		frame->size = size;
+	}
+	frame->next = NULL;
+
+	return frame;
+} /* Multi_GetFrame */
+
+
+/*****************************************************************************
+ *
+ *					Multi_PutFrame
+ *
+ ****************************************************************************/
+static void Multi_PutFrame(struct usbDevice_MultiSlot_Extension *msExt,
+	struct multiSlotFrame *frame)
+{
+	/* do not keep the oversized frames */
+	if (frame->size != msExt->frame_size)
+	{
+		free(frame);
+		return;
+	}
+
+	pthread_mutex_lock(&msExt->frames_mutex);
+	frame->next = msExt->free_frames;
+	msExt->free_frames = frame;
+	pthread_mutex_unlock(&msExt->frames_mutex);
+} /* Multi_PutFrame */
+
+
+/*****************************************************************************
+ *
+ *					Multi_ReadFrame
+ *
+ ****************************************************************************/
+static int Multi_ReadFrame(struct usbDevice_MultiSlot_Extension *msExt,
+	unsigned char *buffer, int length)
+{
+	_usbDevice * usb_device = &msExt->ccid_reader->device;
+	struct usbTransfer *read_transfer = usb_device->read_transfer;
+	int rv;
+
+	rv = submit_bulk_in(msExt->dev_handle, usb_device, buffer, length);
+	if (rv)
+		return rv;
+
+	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+	msExt->read_submitted = true;
+	/* Multi_PollingTerminate() may have been called before
+	 * read_submitted was set */
+	if (msExt->terminated)
+		(void)libusb_cancel_transfer(read_transfer->transfer);
+	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
+
+	/* no timeout: the transfer is cancelled by Multi_PollingTerminate() */
+	rv = wait_transfer(read_transfer, 0);
+
+	pthread_mutex_lock(&usb_device->polling_transfer_mutex);
+	msExt->read_submitted = false;
+	pthread_mutex_unlock(&usb_device->polling_transfer_mutex);
+
+	return rv;
+} /* Multi_ReadFrame */
+
+
+/*****************************************************************************
+ *
+ *					Multi_ReadOversizedFrame
+ *
+ ****************************************************************************/
+static struct multiSlotFrame *Multi_ReadOversizedFrame(
+	struct usbDevice_MultiSlot_Extension *msExt, struct multiSlotFrame *frame,
+	int *length)
+{
+	_usbDevice * usb_device = &msExt->ccid_reader->device;
+	struct usbTransfer *read_transfer = usb_device->read_transfer;
+	struct multiSlotFrame *big_frame;
+	int frame_length;
+	int rv;
+
+	/* the frame filled the buffer: is it complete? */
+	frame_length = 10 + dw2i(frame->buffer, 1);
+	if ((*length < frame->size) || (frame_length <= *length)
+		|| (frame_length > BULK_IN_BUFFER_SIZE))
+		return frame;
+
+	DEBUG_INFO3("Frame of %d bytes but dwMaxCCIDMessageLength is %d",
+		frame_length, usb_device->ccid.dwMaxCCIDMessageLength);
+
+	big_frame = Multi_GetFrame(msExt, FRAME_SIZE(frame_length));
+	if (NULL == big_frame)
+		return frame;
+
+	memcpy(big_frame->buffer, frame->buffer, *length);
+	Multi_PutFrame(msExt, frame);
+
+	/* read the end of the frame */
+	rv = Multi_ReadFrame(msExt, big_frame->buffer + *length,
+		big_frame->size - *length);
+	if (rv < 0)
+		DEBUG_CRITICAL4("read failed (%d/%d): %s",
+			usb_device->bus_number,
+			usb_device->device_address,
+			libusb_error_name(rv));
+	else
+		*length += read_transfer->transfer->actual_length;
+
+	return big_frame;
+} /* Multi_ReadOversizedFrame */
+
+
 /*****************************************************************************
  *
  *					Multi_ReadProc
@@ -2142,14 +3591,16 @@ static void *Multi_ReadProc(void *p_ext)
 	struct multiSlot_ConcurrentAccess *concurrent;
 	CcidDesc * ccid_reader;
 	_usbDevice * usb_device;
+	struct usbTransfer *read_transfer;
 	int rv;
-	unsigned char buffer[10 + MAX_BUFFER_SIZE_EXTENDED];
+	struct multiSlotFrame *frame = NULL;
 	int length;
 
 	msExt = p_ext;
 	concurrent = msExt->concurrent;
 	ccid_reader = msExt->ccid_reader;
 	usb_device = &ccid_reader->device;
+	read_transfer = usb_device->read_transfer;
 
 	DEBUG_COMM3("Multi_ReadProc (%d/%d): thread starting",
 		usb_device->bus_number,
@@ -2159,16 +3610,26 @@ static void *Multi_ReadProc(void *p_ext)
 	{
 		int slot;
 
+		/* the frame is received directly in a buffer of the pool */
+		if (NULL == frame)
+		{
+			frame = Multi_GetFrame(msExt, msExt->frame_size);
+			if (NULL == frame)
+			{
+				(void)usleep(100*1000);
+				continue;
+			}
+		}
+
 		DEBUG_COMM2("Waiting read for reader %X", ccid_reader->lun);
-		rv = libusb_bulk_transfer(msExt->dev_handle,
-			usb_device->bulk_in, buffer, sizeof buffer,
-			&length, 5 * 1000);
+		rv = Multi_ReadFrame(msExt, frame->buffer, frame->size);
+		length = read_transfer->transfer->actual_length;
 
 		if (rv < 0)
 		{
-			/* timeout are expected since we read continuously */
-			if (LIBUSB_ERROR_TIMEOUT == rv)
-				continue;
+			/* cancelled by Multi_PollingTerminate() */
+			if (msExt->terminated)
+				break;
 
 			DEBUG_CRITICAL4("read failed (%d/%d): %s",
 				usb_device->bus_number,
@@ -2181,22 +3642,54 @@ static void *Multi_ReadProc(void *p_ext)
 			if (LIBUSB_ERROR_NO_DEVICE != rv)
 				continue;
 		}
+		else
+			/* bogus dwMaxCCIDMessageLength */
+			frame = Multi_ReadOversizedFrame(msExt, frame, &length);
 
-#define BSLOT_OFFSET 5
-		slot = buffer[BSLOT_OFFSET];
+		slot = frame->buffer[BSLOT_OFFSET];
 		DEBUG_COMM3("Read %d bytes for slot %d", length, slot);
 
-		/* copy and signal */
+		if (slot > usb_device->ccid.bMaxSlotIndex)
+		{
+			DEBUG_CRITICAL2("Invalid slot: %d", slot);
+			continue;
+		}
+
+		/* hand the frame over to the slot and signal */
 		pthread_mutex_lock(&concurrent[slot].slot_mutex);
 
-		memcpy(concurrent[slot].buffer, buffer, length);
+		/* response to a previous (abandoned) command of this slot */
+		if ((length > BSEQ_OFFSET)
+			&& (frame->buffer[BSEQ_OFFSET] != concurrent[slot].bSeq))
+		{
+			pthread_mutex_unlock(&concurrent[slot].slot_mutex);
+			DEBUG_INFO4("Unexpected bSeq %d for slot %d (expected %d)",
+				frame->buffer[BSEQ_OFFSET], slot, concurrent[slot].bSeq);
+			continue;
+		}
+
+		struct multiSlotFrame *previous_frame = concurrent[slot].frame;
+		concurrent[slot].frame = frame;
 		concurrent[slot].length = length;
 		pthread_cond_signal(&concurrent[slot].slot_condition);
 		DEBUG_COMM3("Signaled reader %X slot %d", ccid_reader->lun, slot);
 
 		pthread_mutex_unlock(&concurrent[slot].slot_mutex);
+
+		/* a frame not read by the slot is overwritten */
+		frame = NULL;
+		if (previous_frame)
+		{
+			if (previous_frame->size == msExt->frame_size)
+				frame = previous_frame;
+			else
+				Multi_PutFrame(msExt, previous_frame);
+		}
 	}
 
+	if (frame)
+		Multi_PutFrame(msExt, frame);
+
 	DEBUG_COMM3("Multi_ReadProc (%d/%d): Thread terminated",
 		usb_device->bus_number,
 		usb_device->device_address);
@@ -2227,19 +3720,12 @@ static struct usbDevice_MultiSlot_Extension *Multi_CreateFirstSlot(CcidDesc * cc
 	msExt->dev_handle = ccid_reader->device.dev_handle;
 
 	atomic_init(&msExt->terminated, false);
-	msExt->status = 0;
+	msExt->read_submitted = false;
 
-	/* Create mutex and condition object for the interrupt polling */
+	/* Create mutex for the interrupt polling */
 	pthread_mutex_init(&msExt->mutex, NULL);
 #ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
 	pthread_condattr_t condattr;
-
-	pthread_condattr_init(&condattr);
-	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
-	pthread_cond_init(&msExt->condition, &condattr);
-	pthread_condattr_destroy(&condattr);
-#else
-	pthread_cond_init(&msExt->condition, NULL);
 #endif
 
 	/* concurrent USB read */
@@ -2259,13 +3745,41 @@ static struct usbDevice_MultiSlot_Extension *Multi_CreateFirstSlot(CcidDesc * cc
 		pthread_condattr_init(&condattr);
 		pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
 		pthread_cond_init(&concurrent[slot].slot_condition, &condattr);
+		pthread_cond_init(&concurrent[slot].interrupt_condition, &condattr);
 		pthread_condattr_destroy(&condattr);
 #else
 		pthread_cond_init(&concurrent[slot].slot_condition, NULL);
+		pthread_cond_init(&concurrent[slot].interrupt_condition, NULL);
 #endif
+
+		/* the interrupt endpoint is polled by Multi_PollingProc() */
+		concurrent[slot].presence.state = PRESENCE_UNKNOWN;
 	}
 	msExt->concurrent = concurrent;
 
+	/* frames are allocated by Multi_ReadProc() when needed */
+	msExt->frame_size = FRAME_SIZE(ccid_reader->device.ccid.dwMaxCCIDMessageLength);
+	if ((0 == msExt->frame_size)
+		|| (msExt->frame_size > FRAME_SIZE(BULK_IN_BUFFER_SIZE)))
+		msExt->frame_size = FRAME_SIZE(BULK_IN_BUFFER_SIZE);
+	msExt->free_frames = NULL;
+	pthread_mutex_init(&msExt->frames_mutex, NULL);
+
+	/* commands sent concurrently to different slots */
+	msExt->busy_slots = 0;
+	msExt->max_busy_slots = ccid_reader->device.ccid.bMaxCCIDBusySlots;
+	if (msExt->max_busy_slots < 1)
+		msExt->max_busy_slots = 1;
+	pthread_mutex_init(&msExt->busy_mutex, NULL);
+#ifdef HAVE_PTHREAD_CONDATTR_SETCLOCK
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&msExt->busy_condition, &condattr);
+	pthread_condattr_destroy(&condattr);
+#else
+	pthread_cond_init(&msExt->busy_condition, NULL);
+#endif
+
 	/* create the thread in charge of the interrupt polling */
 	pthread_create(&msExt->thread_proc, NULL, Multi_PollingProc, msExt);
 
@@ -26,8 +26,15 @@ status_t OpenUSBByName(CcidDesc * ccid_reader, /*@null@*/ char *device);
 status_t WriteUSB(CcidDesc * ccid_reader, unsigned int length,
 	unsigned char *Buffer);
 
+#include <sys/uio.h>
+status_t WritevUSB(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt);
+
 status_t ReadUSB(CcidDesc * ccid_reader, unsigned int *length,
-	/*@out@*/ unsigned char *Buffer, int bSeq);
+	/*@out@*/ unsigned char *Buffer, int bSeq, unsigned int timeout);
+
+status_t ReadvUSB(CcidDesc * ccid_reader, const struct iovec *iov,
+	int iovcnt, unsigned int *length, int bSeq, unsigned int timeout);
 
 status_t CloseUSB(CcidDesc * ccid_reader);
 status_t DisconnectUSB(CcidDesc * ccid_reader);
@@ -45,4 +52,7 @@ int ControlUSB(CcidDesc * ccid_reader, int requesttype, int request, int value,
 
 int InterruptRead(CcidDesc * ccid_reader, int timeout);
 void InterruptStop(CcidDesc * ccid_reader);
+int InterruptGetPresence(CcidDesc * ccid_reader, unsigned int *events);
+void InterruptSetPresence(CcidDesc * ccid_reader, unsigned int events,
+	int presence);
 #endif
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <pcsclite.h>
 #include <ifdhandler.h>
@@ -52,6 +53,13 @@
 #define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
 #endif
 
+/* first wait (in microseconds) when an ICCD device is busy. The wait is
+ * then doubled up to the maximum delay */
+#define ICCD_WAIT_MIN 500
+
+/* timeout (in ms) for the response to PC_to_RDR_Abort */
+#define ABORT_TIMEOUT 1000
+
 #define CHECK_STATUS(res) \
 	if (STATUS_NO_SUCH_DEVICE == res) \
 		return IFD_NO_SUCH_DEVICE; \
@@ -61,23 +69,40 @@
 /* internal functions */
 static RESPONSECODE CmdXfrBlockAPDU_extended(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[]);
+	unsigned char rx_buffer[], unsigned int timeout);
 
 static RESPONSECODE CmdXfrBlockTPDU_T0(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[]);
+	unsigned char rx_buffer[], unsigned int timeout);
 
 static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader, unsigned int
 	tx_length, unsigned char tx_buffer[], unsigned int *rx_length, unsigned
-	char rx_buffer[]);
+	char rx_buffer[], unsigned int timeout);
 
 static RESPONSECODE CmdXfrBlockTPDU_T1(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[]);
+	unsigned char rx_buffer[], unsigned int timeout);
+
+static RESPONSECODE CmdXfrBlockT0_GetResponse(CcidDesc * ccid_reader,
+	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
+	unsigned char rx_buffer[], unsigned int timeout);
+
+static RESPONSECODE transmit(CcidDesc * ccid_reader, unsigned int tx_length,
+	const unsigned char tx_buffer[], unsigned short rx_length,
+	unsigned char bBWI, bool headroom);
+
+static RESPONSECODE receive(CcidDesc * ccid_reader, unsigned int *rx_length,
+	unsigned char rx_buffer[], unsigned char *chain_parameter,
+	unsigned int timeout, bool headroom);
 
 static void i2dw(int value, unsigned char *buffer);
 static unsigned int bei2i(unsigned char *buffer);
 
+#ifndef TWIN_SERIAL
+static unsigned int ICCD_Wait(_ccid_descriptor *ccid_descriptor,
+	unsigned int wait, unsigned int max_wait);
+#endif
+
 
 /*****************************************************************************
  *
@@ -85,8 +110,9 @@ static unsigned int bei2i(unsigned char *buffer);
  *
  ****************************************************************************/
 RESPONSECODE CmdPowerOn(CcidDesc * ccid_reader, unsigned int * nlength,
-	unsigned char buffer[], int voltage)
+	unsigned char buffer[], int *pvoltage, bool fallback, unsigned int timeout)
 {
+	int voltage = *pvoltage;
 	unsigned char cmd[CCID_HEADER_SIZE];
 	unsigned char resp[CCID_HEADER_SIZE + MAX_ATR_SIZE];
 	int bSeq;
@@ -109,7 +135,7 @@ RESPONSECODE CmdPowerOn(CcidDesc * ccid_reader, unsigned int * nlength,
 			return r;
 
 		/* wait for ready */
-		r = CmdGetSlotStatus(ccid_reader, pcbuffer);
+		r = CmdGetSlotStatus(ccid_reader, pcbuffer, timeout);
 		if (r != IFD_SUCCESS)
 			return r;
 
@@ -229,7 +255,7 @@ again:
 
 	length = sizeof resp;
 
-	res = ReadPort(ccid_reader, &length, resp, bSeq);
+	res = ReadPort(ccid_reader, &length, resp, bSeq, timeout);
 	CHECK_STATUS(res)
 
 	if (length < CCID_RESPONSE_HEADER_SIZE)
@@ -262,7 +288,7 @@ again:
 		}
 
 		/* continue with other voltage values */
-		if (voltage)
+		if (voltage && fallback)
 		{
 #ifndef NO_LOG
 			const char *voltage_code[] = { "1.8V", "5V", "3V", "1.8V" };
@@ -293,6 +319,9 @@ again:
 
 	memcpy(buffer, resp + CCID_HEADER_SIZE, atr_len);
 
+	/* voltage accepted by the card */
+	*pvoltage = voltage;
+
 	return return_value;
 } /* CmdPowerOn */
 
@@ -310,7 +339,7 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 	unsigned int a, b;
 	PIN_VERIFY_STRUCTURE *pvs;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
-	int old_read_timeout;
+	unsigned int timeout;
 	RESPONSECODE ret;
 	status_t res;
 	unsigned int rx_capacity = *RxLength;
@@ -498,8 +527,7 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 
 	i2dw(a - CCID_HEADER_SIZE, cmd + 1);  /* CCID message length */
 
-	old_read_timeout = ccid_descriptor -> readTimeout;
-	ccid_descriptor -> readTimeout = max(90, TxBuffer[0] + 10)*1000;	/* at least 90 seconds */
+	timeout = max(90, TxBuffer[0] + 10)*1000;	/* at least 90 seconds */
 
 	res = WritePort(ccid_reader, a, cmd);
 	if (STATUS_SUCCESS != res)
@@ -511,7 +539,7 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 		goto end;
 	}
 
-	ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL);
+	ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL, timeout);
 
 	/* T=1 Protocol Management for a TPDU reader */
 	if ((SCARD_PROTOCOL_T1 == ccid_descriptor->cardProtocol)
@@ -563,10 +591,9 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 
 				if (t1->wtx > 1)
 				{
-					/* set the new temporary timeout at WTX card request */
-					ccid_descriptor->readTimeout *= t1->wtx;
-					DEBUG_INFO2("New timeout at WTX request: %d sec",
-							ccid_descriptor->readTimeout);
+					/* set the new timeout at WTX card request */
+					timeout *= t1->wtx;
+					DEBUG_INFO2("New timeout at WTX request: %d ms", timeout);
 				}
 
 				ct_buf_init(&tbuf, sblk, sizeof(sblk));
@@ -589,7 +616,7 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 					ret = IFD_ERROR_INSUFFICIENT_BUFFER;
 					goto end;
 				}
-				ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL);
+				ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL, timeout);
 				if (ret != IFD_SUCCESS)
 					goto end;
 			}
@@ -608,9 +635,6 @@ RESPONSECODE SecurePINVerify(CcidDesc * ccid_reader,
 	}
 
 end:
-	/* Restore initial timeout */
-	ccid_descriptor -> readTimeout = old_read_timeout;
-
 	return ret;
 } /* SecurePINVerify */
 
@@ -666,7 +690,7 @@ RESPONSECODE SecurePINModify(CcidDesc * ccid_reader,
 	unsigned int a, b;
 	PIN_MODIFY_STRUCTURE *pms;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
-	int old_read_timeout;
+	unsigned int timeout;
 	RESPONSECODE ret;
 	status_t res;
 #ifdef BOGUS_PINPAD_FIRMWARE
@@ -886,8 +910,7 @@ RESPONSECODE SecurePINModify(CcidDesc * ccid_reader,
 	/* We know the size of the CCID message now */
 	i2dw(a - CCID_HEADER_SIZE, cmd + 1);	/* command length (includes bPINOperation) */
 
-	old_read_timeout = ccid_descriptor -> readTimeout;
-	ccid_descriptor -> readTimeout = max(90, TxBuffer[0]+10)*1000;	/* at least 90 seconds */
+	timeout = max(90, TxBuffer[0]+10)*1000;	/* at least 90 seconds */
 
 	res = WritePort(ccid_reader, a, cmd);
 	if (STATUS_SUCCESS != res)
@@ -899,7 +922,7 @@ RESPONSECODE SecurePINModify(CcidDesc * ccid_reader,
 		goto end;
 	}
 
-	ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL);
+	ret = CCID_Receive(ccid_reader, RxLength, RxBuffer, NULL, timeout);
 
 	/* T=1 Protocol Management for a TPDU reader */
 	if ((SCARD_PROTOCOL_T1 == ccid_descriptor->cardProtocol)
@@ -924,7 +947,6 @@ RESPONSECODE SecurePINModify(CcidDesc * ccid_reader,
 	}
 
 end:
-	ccid_descriptor -> readTimeout = old_read_timeout;
 	return ret;
 } /* SecurePINModify */
 
@@ -953,34 +975,24 @@ RESPONSECODE CmdEscapeCheck(CcidDesc * ccid_reader,
 	unsigned char RxBuffer[], unsigned int *RxLength, unsigned int timeout,
 	bool mayfail)
 {
-	unsigned char *cmd_in, *cmd_out;
+	unsigned char cmd_in[CCID_HEADER_SIZE], *cmd_out;
+	struct iovec iov[2];
 	int bSeq;
 	status_t res;
 	unsigned int length_in, length_out;
 	RESPONSECODE return_value = IFD_SUCCESS;
-	int old_read_timeout = -1;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
 
-	/* a value of 0 do not change the default read timeout */
-	if (timeout > 0)
-	{
-		old_read_timeout = ccid_descriptor -> readTimeout;
-		ccid_descriptor -> readTimeout = timeout;
-	}
+	/* a value of 0 uses the default read timeout */
+	if (0 == timeout)
+		timeout = ccid_descriptor -> readTimeout;
 
 again:
 	/* allocate buffers */
 	length_in = CCID_HEADER_SIZE + TxLength;
-	if (NULL == (cmd_in = malloc(length_in)))
-	{
-		return_value = IFD_COMMUNICATION_ERROR;
-		goto end;
-	}
-
 	length_out = CCID_HEADER_SIZE + *RxLength;
 	if (NULL == (cmd_out = malloc(length_out)))
 	{
-		free(cmd_in);
 		return_value = IFD_COMMUNICATION_ERROR;
 		goto end;
 	}
@@ -992,11 +1004,13 @@ again:
 	cmd_in[6] = bSeq;
 	cmd_in[7] = cmd_in[8] = cmd_in[9] = 0; /* RFU */
 
-	/* copy the command */
-	memcpy(&cmd_in[CCID_HEADER_SIZE], TxBuffer, TxLength);
+	/* the command is sent without copying it after the header */
+	iov[0].iov_base = cmd_in;
+	iov[0].iov_len = sizeof cmd_in;
+	iov[1].iov_base = (unsigned char *)TxBuffer;
+	iov[1].iov_len = TxLength;
 
-	res = WritePort(ccid_reader, length_in, cmd_in);
-	free(cmd_in);
+	res = WritevPort(ccid_reader, iov, TxLength ? 2 : 1);
 	if (res != STATUS_SUCCESS)
 	{
 		free(cmd_out);
@@ -1009,7 +1023,7 @@ again:
 
 time_request:
 	length_out = CCID_HEADER_SIZE + *RxLength;
-	res = ReadPort(ccid_reader, &length_out, cmd_out, bSeq);
+	res = ReadPort(ccid_reader, &length_out, cmd_out, bSeq, timeout);
 
 	/* replay the command if NAK
 	 * This (generally) happens only for the first command sent to the reader
@@ -1066,9 +1080,6 @@ time_request:
 	free(cmd_out);
 
 end:
-	if (timeout > 0)
-		ccid_descriptor -> readTimeout = old_read_timeout;
-
 	return return_value;
 } /* EscapeCheck */
 
@@ -1145,7 +1156,8 @@ RESPONSECODE CmdPowerOff(CcidDesc * ccid_reader)
 	CHECK_STATUS(res)
 
 	length = sizeof(cmd);
-	res = ReadPort(ccid_reader, &length, cmd, bSeq);
+	res = ReadPort(ccid_reader, &length, cmd, bSeq,
+		ccid_descriptor->readTimeout);
 	CHECK_STATUS(res)
 
 	if (length < CCID_RESPONSE_HEADER_SIZE)
@@ -1164,13 +1176,83 @@ RESPONSECODE CmdPowerOff(CcidDesc * ccid_reader)
 } /* CmdPowerOff */
 
 
+/*****************************************************************************
+ *
+ *					CmdAbort
+ *
+ ****************************************************************************/
+RESPONSECODE CmdAbort(CcidDesc * ccid_reader)
+{
+#ifndef TWIN_SERIAL
+	unsigned char cmd[CCID_HEADER_SIZE];
+	int bSeq, r;
+	status_t res;
+	unsigned int length;
+	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
+
+	/* no Abort command for ICCD */
+	if ((PROTOCOL_ICCD_A == ccid_descriptor->bInterfaceProtocol)
+		|| (PROTOCOL_ICCD_B == ccid_descriptor->bInterfaceProtocol))
+		return IFD_NOT_SUPPORTED;
+
+	bSeq = (*ccid_descriptor->pbSeq)++;
+
+	DEBUG_COMM3("Abort slot %d, bSeq: %d",
+		ccid_descriptor->bCurrentSlotIndex, bSeq);
+
+	/* See CCID v1.1 ch. 5.3.1 ABORT page 23
+	 * the class specific request is sent first and then the
+	 * PC_to_RDR_Abort command with the same bSlot and bSeq */
+	r = ControlUSB(ccid_reader, 0x21, 0x01 /* ABORT */,
+		(bSeq << 8) | ccid_descriptor->bCurrentSlotIndex, NULL, 0);
+	if (r < 0)
+		return IFD_COMMUNICATION_ERROR;
+
+	cmd[0] = PC_to_RDR_Abort;
+	cmd[1] = cmd[2] = cmd[3] = cmd[4] = 0;	/* dwLength */
+	cmd[5] = ccid_descriptor->bCurrentSlotIndex;	/* slot number */
+	cmd[6] = bSeq;
+	cmd[7] = cmd[8] = cmd[9] = 0; /* RFU */
+
+	res = WritePort(ccid_reader, sizeof(cmd), cmd);
+	CHECK_STATUS(res)
+
+	/* the response of the aborted command, if any, has a different bSeq
+	 * and is discarded by ReadPort() */
+	length = sizeof(cmd);
+	res = ReadPort(ccid_reader, &length, cmd, bSeq, ABORT_TIMEOUT);
+	CHECK_STATUS(res)
+
+	if (length < CCID_RESPONSE_HEADER_SIZE)
+	{
+		DEBUG_CRITICAL2("Not enough data received: %d bytes", length);
+		return IFD_COMMUNICATION_ERROR;
+	}
+
+	if (cmd[STATUS_OFFSET] & CCID_COMMAND_FAILED)
+	{
+		ccid_error(PCSC_LOG_ERROR, cmd[ERROR_OFFSET], __FILE__, __LINE__, __FUNCTION__);	/* bError */
+		return IFD_COMMUNICATION_ERROR;
+	}
+
+	return IFD_SUCCESS;
+#else
+	(void)ccid_reader;
+
+	/* the ABORT class specific request needs a USB control pipe */
+	return IFD_NOT_SUPPORTED;
+#endif
+} /* CmdAbort */
+
+
 /*****************************************************************************
  *
  *					CmdGetSlotStatus
  *
  ****************************************************************************/
 RESPONSECODE CmdGetSlotStatus(CcidDesc * ccid_reader,
-	unsigned char buffer[static SIZE_GET_SLOT_STATUS])
+	unsigned char buffer[static SIZE_GET_SLOT_STATUS],
+	unsigned int timeout)
 {
 	unsigned char cmd[CCID_HEADER_SIZE];
 	int bSeq;
@@ -1184,6 +1266,7 @@ RESPONSECODE CmdGetSlotStatus(CcidDesc * ccid_reader,
 	{
 		int r;
 		unsigned char status[1];
+		unsigned int wait = ICCD_WAIT_MIN;
 
 again_status:
 		/* SlotStatus */
@@ -1202,7 +1285,7 @@ again_status:
 		if (status[0] & 0x40)
 		{
 			DEBUG_INFO2("Busy: 0x%02X", status[0]);
-			(void)usleep(1000 * 10);
+			wait = ICCD_Wait(ccid_descriptor, wait, 1000 * 10);
 			goto again_status;
 		}
 
@@ -1272,7 +1355,7 @@ again_status:
 	CHECK_STATUS(res)
 
 	length = SIZE_GET_SLOT_STATUS;
-	res = ReadPort(ccid_reader, &length, buffer, bSeq);
+	res = ReadPort(ccid_reader, &length, buffer, bSeq, timeout);
 	CHECK_STATUS(res)
 
 	if (length < CCID_RESPONSE_HEADER_SIZE)
@@ -1300,44 +1383,52 @@ again_status:
  ****************************************************************************/
 RESPONSECODE CmdXfrBlock(CcidDesc * ccid_reader, unsigned int tx_length,
 	unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[], int protocol)
+	unsigned char rx_buffer[], int protocol, unsigned int timeout)
 {
 	RESPONSECODE return_value = IFD_SUCCESS;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
+	int exchange = ccid_descriptor->dwFeatures & CCID_CLASS_EXCHANGE_MASK;
+
+	/* 61xx and 6Cxx handled by the driver */
+	if ((T_0 == protocol)
+		&& (DriverOptions & DRIVER_OPTION_T0_GET_RESPONSE)
+		&& ((CCID_CLASS_TPDU == exchange) || (CCID_CLASS_CHARACTER == exchange)))
+		return CmdXfrBlockT0_GetResponse(ccid_reader, tx_length, tx_buffer,
+			rx_length, rx_buffer, timeout);
 
 	/* APDU or TPDU? */
-	switch (ccid_descriptor->dwFeatures & CCID_CLASS_EXCHANGE_MASK)
+	switch (exchange)
 	{
 		case CCID_CLASS_TPDU:
 			if (protocol == T_0)
 				return_value = CmdXfrBlockTPDU_T0(ccid_reader,
-					tx_length, tx_buffer, rx_length, rx_buffer);
+					tx_length, tx_buffer, rx_length, rx_buffer, timeout);
 			else
 				if (protocol == T_1)
 					return_value = CmdXfrBlockTPDU_T1(ccid_reader, tx_length,
-						tx_buffer, rx_length, rx_buffer);
+						tx_buffer, rx_length, rx_buffer, timeout);
 				else
 					return_value = IFD_PROTOCOL_NOT_SUPPORTED;
 			break;
 
 		case CCID_CLASS_SHORT_APDU:
 			return_value = CmdXfrBlockTPDU_T0(ccid_reader,
-				tx_length, tx_buffer, rx_length, rx_buffer);
+				tx_length, tx_buffer, rx_length, rx_buffer, timeout);
 			break;
 
 		case CCID_CLASS_EXTENDED_APDU:
 			return_value = CmdXfrBlockAPDU_extended(ccid_reader,
-				tx_length, tx_buffer, rx_length, rx_buffer);
+				tx_length, tx_buffer, rx_length, rx_buffer, timeout);
 			break;
 
 		case CCID_CLASS_CHARACTER:
 			if (protocol == T_0)
 				return_value = CmdXfrBlockCHAR_T0(ccid_reader, tx_length,
-					tx_buffer, rx_length, rx_buffer);
+					tx_buffer, rx_length, rx_buffer, timeout);
 			else
 				if (protocol == T_1)
 					return_value = CmdXfrBlockTPDU_T1(ccid_reader, tx_length,
-						tx_buffer, rx_length, rx_buffer);
+						tx_buffer, rx_length, rx_buffer, timeout);
 				else
 					return_value = IFD_PROTOCOL_NOT_SUPPORTED;
 			break;
@@ -1358,7 +1449,34 @@ RESPONSECODE CmdXfrBlock(CcidDesc * ccid_reader, unsigned int tx_length,
 RESPONSECODE CCID_Transmit(CcidDesc * ccid_reader, unsigned int tx_length,
 	const unsigned char tx_buffer[], unsigned short rx_length, unsigned char bBWI)
 {
-	unsigned char cmd[CCID_HEADER_SIZE + tx_length];	/* CCID + APDU buffer */
+	return transmit(ccid_reader, tx_length, tx_buffer, rx_length, bBWI, false);
+} /* CCID_Transmit */
+
+
+/*****************************************************************************
+ *
+ *					CCID_TransmitInPlace
+ *
+ ****************************************************************************/
+RESPONSECODE CCID_TransmitInPlace(CcidDesc * ccid_reader,
+	unsigned int tx_length, unsigned char tx_buffer[],
+	unsigned short rx_length, unsigned char bBWI)
+{
+	return transmit(ccid_reader, tx_length, tx_buffer, rx_length, bBWI, true);
+} /* CCID_TransmitInPlace */
+
+
+/*****************************************************************************
+ *
+ *					transmit
+ *
+ ****************************************************************************/
+static RESPONSECODE transmit(CcidDesc * ccid_reader, unsigned int tx_length,
+	const unsigned char tx_buffer[], unsigned short rx_length,
+	unsigned char bBWI, bool headroom)
+{
+	unsigned char header[CCID_HEADER_SIZE], *cmd = header;	/* CCID header */
+	struct iovec iov[2];
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
 	status_t ret;
 
@@ -1405,6 +1523,11 @@ RESPONSECODE CCID_Transmit(CcidDesc * ccid_reader, unsigned int tx_length,
 	}
 #endif
 
+	/* the header is written in the room reserved before the APDU so that
+	 * the frame is contiguous and sent without copying the APDU */
+	if (headroom && tx_buffer)
+		cmd = (unsigned char *)tx_buffer - CCID_HEADER_SIZE;
+
 	cmd[0] = PC_to_RDR_XfrBlock;
 	i2dw(tx_length, cmd+1);	/* APDU length */
 	cmd[5] = ccid_descriptor->bCurrentSlotIndex;	/* slot number */
@@ -1413,14 +1536,16 @@ RESPONSECODE CCID_Transmit(CcidDesc * ccid_reader, unsigned int tx_length,
 	cmd[8] = rx_length & 0xFF;	/* Expected length, in character mode only */
 	cmd[9] = (rx_length >> 8) & 0xFF;
 
-	if (tx_buffer)
-		memcpy(cmd + CCID_HEADER_SIZE, tx_buffer, tx_length);
+	iov[0].iov_base = cmd;
+	iov[0].iov_len = CCID_HEADER_SIZE;
+	iov[1].iov_base = (unsigned char *)tx_buffer;
+	iov[1].iov_len = tx_length;
 
-	ret = WritePort(ccid_reader, CCID_HEADER_SIZE + tx_length, cmd);
+	ret = WritevPort(ccid_reader, iov, (tx_buffer && tx_length) ? 2 : 1);
 	CHECK_STATUS(ret)
 
 	return IFD_SUCCESS;
-} /* CCID_Transmit */
+} /* transmit */
 
 
 /*****************************************************************************
@@ -1429,14 +1554,45 @@ RESPONSECODE CCID_Transmit(CcidDesc * ccid_reader, unsigned int tx_length,
  *
  ****************************************************************************/
 RESPONSECODE CCID_Receive(CcidDesc * ccid_reader, unsigned int *rx_length,
-	unsigned char rx_buffer[], unsigned char *chain_parameter)
+	unsigned char rx_buffer[], unsigned char *chain_parameter,
+	unsigned int timeout)
+{
+	return receive(ccid_reader, rx_length, rx_buffer, chain_parameter,
+		timeout, false);
+} /* CCID_Receive */
+
+
+/*****************************************************************************
+ *
+ *					CCID_ReceiveInPlace
+ *
+ ****************************************************************************/
+RESPONSECODE CCID_ReceiveInPlace(CcidDesc * ccid_reader,
+	unsigned int *rx_length, unsigned char rx_buffer[], unsigned int timeout)
 {
-	unsigned char cmd[CCID_HEADER_SIZE + CMD_BUF_SIZE];	/* CCID + APDU buffer */
+	return receive(ccid_reader, rx_length, rx_buffer, NULL, timeout, true);
+} /* CCID_ReceiveInPlace */
+
+
+/*****************************************************************************
+ *
+ *					receive
+ *
+ ****************************************************************************/
+static RESPONSECODE receive(CcidDesc * ccid_reader, unsigned int *rx_length,
+	unsigned char rx_buffer[], unsigned char *chain_parameter,
+	unsigned int timeout, bool headroom)
+{
+	unsigned char header[CCID_HEADER_SIZE], *cmd = header;	/* CCID header */
+	struct iovec iov[2];
 	unsigned int length;
 	RESPONSECODE return_value = IFD_SUCCESS;
 	status_t ret;
+#ifndef TWIN_SERIAL
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
-	unsigned int old_timeout;
+#endif
+	struct timespec deadline;
+	unsigned int remaining;
 
 #ifndef TWIN_SERIAL
 	if (PROTOCOL_ICCD_A == ccid_descriptor->bInterfaceProtocol)
@@ -1445,7 +1601,7 @@ RESPONSECODE CCID_Receive(CcidDesc * ccid_reader, unsigned int *rx_length,
 		int r;
 
 		/* wait for ready */
-		r = CmdGetSlotStatus(ccid_reader, pcbuffer);
+		r = CmdGetSlotStatus(ccid_reader, pcbuffer, timeout);
 		if (r != IFD_SUCCESS)
 			return r;
 
@@ -1471,6 +1627,7 @@ RESPONSECODE CCID_Receive(CcidDesc * ccid_reader, unsigned int *rx_length,
 		unsigned char rx_tmp[4];
 		unsigned char *old_rx_buffer = NULL;
 		int old_rx_length = 0;
+		unsigned int wait = ICCD_WAIT_MIN;
 
 		/* read a nul block. buffer need to be at least 4-bytes */
 		if (NULL == rx_buffer)
@@ -1530,7 +1687,10 @@ time_request_ICCD_B:
 				if (0 == delay)
 					/* host select the delay */
 					delay = 1;
-				(void)usleep(delay * 1000 * 10);
+
+				/* the delay is a maximum. The response may be ready
+				 * before */
+				wait = ICCD_Wait(ccid_descriptor, wait, delay * 1000 * 10);
 				goto time_request_ICCD_B;
 			}
 
@@ -1556,15 +1716,35 @@ time_request_ICCD_B:
 	}
 #endif
 
-	/* store the original value of read timeout*/
-	old_timeout = ccid_descriptor -> readTimeout;
+	/* the timeout is for the complete response, time extensions
+	 * included */
+	deadline_init(&deadline, timeout);
 
 time_request:
-	length = sizeof(cmd);
-	ret = ReadPort(ccid_reader, &length, cmd, -1);
+	remaining = deadline_remaining(&deadline);
+	if (0 == remaining)
+	{
+		DEBUG_CRITICAL2("Timeout (%d ms)", timeout);
+		(void)CmdAbort(ccid_reader);
+		return IFD_COMMUNICATION_ERROR;
+	}
 
-	/* restore the original value of read timeout */
-	ccid_descriptor -> readTimeout = old_timeout;
+	/* the header and the payload are received separately so that the
+	 * payload lands directly in rx_buffer. The header is received in
+	 * the room reserved before rx_buffer, if any, so that the frame is
+	 * received without copying the payload */
+	if (headroom && rx_buffer)
+		cmd = rx_buffer - CCID_HEADER_SIZE;
+	iov[0].iov_base = cmd;
+	iov[0].iov_len = CCID_HEADER_SIZE;
+	iov[1].iov_base = rx_buffer;
+	iov[1].iov_len = rx_buffer ? *rx_length : 0;
+	ret = ReadvPort(ccid_reader, iov, 2, &length, -1, remaining);
+
+	/* time out or interrupted by InterruptStop(): abort the command so
+	 * that the slot can be used again without waiting for the card */
+	if (STATUS_UNSUCCESSFUL == ret)
+		(void)CmdAbort(ccid_reader);
 	CHECK_STATUS(ret)
 
 	if (length < CCID_RESPONSE_HEADER_SIZE)
@@ -1612,11 +1792,14 @@ time_request:
 	{
 		DEBUG_COMM2("Time extension requested: 0x%02X", cmd[ERROR_OFFSET]);
 
-		/* compute the new value of read timeout */
+		/* bError is a multiplier of the initial timeout added to
+		 * what is left of the budget */
 		if (cmd[ERROR_OFFSET] > 0)
-			ccid_descriptor -> readTimeout *= cmd[ERROR_OFFSET];
+			deadline_extend(&deadline, timeout * cmd[ERROR_OFFSET]);
+		else
+			deadline_extend(&deadline, timeout);
 
-		DEBUG_COMM2("New timeout: %d ms", ccid_descriptor -> readTimeout);
+		DEBUG_COMM2("New timeout: %d ms", deadline_remaining(&deadline));
 		goto time_request;
 	}
 
@@ -1644,9 +1827,6 @@ time_request:
 		DEBUG_CRITICAL2("Nul block expected but got %d bytes", length);
 		return_value = IFD_COMMUNICATION_ERROR;
 	}
-	else
-		if (length)
-			memcpy(rx_buffer, cmd + CCID_HEADER_SIZE, length);
 
 	/* Extended case?
 	 * Only valid for RDR_to_PC_DataBlock frames */
@@ -1654,7 +1834,7 @@ time_request:
 		*chain_parameter = cmd[CHAIN_PARAMETER_OFFSET];
 
 	return return_value;
-} /* CCID_Receive */
+} /* receive */
 
 
 /*****************************************************************************
@@ -1664,7 +1844,7 @@ time_request:
  ****************************************************************************/
 static RESPONSECODE CmdXfrBlockAPDU_extended(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[])
+	unsigned char rx_buffer[], unsigned int timeout)
 {
 	RESPONSECODE return_value;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
@@ -1718,7 +1898,7 @@ send_next_block:
 		goto receive_block;
 
 	/* read a nul block */
-	return_value = CCID_Receive(ccid_reader, &local_rx_length, NULL, NULL);
+	return_value = CCID_Receive(ccid_reader, &local_rx_length, NULL, NULL, timeout);
 	if (return_value != IFD_SUCCESS)
 		return return_value;
 
@@ -1748,7 +1928,7 @@ receive_block:
 receive_next_block:
 	local_rx_length = *rx_length - received_length;
 	return_value = CCID_Receive(ccid_reader, &local_rx_length, rx_buffer,
-		&chain_parameter);
+		&chain_parameter, timeout);
 	if (IFD_ERROR_INSUFFICIENT_BUFFER == return_value)
 	{
 		buffer_overflow = 1;
@@ -1809,7 +1989,7 @@ receive_next_block:
  ****************************************************************************/
 static RESPONSECODE CmdXfrBlockTPDU_T0(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[])
+	unsigned char rx_buffer[], unsigned int timeout)
 {
 	RESPONSECODE return_value = IFD_SUCCESS;
 	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
@@ -1847,10 +2027,106 @@ static RESPONSECODE CmdXfrBlockTPDU_T0(CcidDesc * ccid_reader,
 	if (return_value != IFD_SUCCESS)
 		return return_value;
 
-	return CCID_Receive(ccid_reader, rx_length, rx_buffer, NULL);
+	return CCID_Receive(ccid_reader, rx_length, rx_buffer, NULL, timeout);
 } /* CmdXfrBlockTPDU_T0 */
 
 
+/*****************************************************************************
+ *
+ *					CmdXfrBlockT0_GetResponse
+ *
+ ****************************************************************************/
+static RESPONSECODE CmdXfrBlockT0_GetResponse(CcidDesc * ccid_reader,
+	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
+	unsigned char rx_buffer[], unsigned int timeout)
+{
+	/* ISO 7816-3 T=0 APDU transport: the driver sends the GET RESPONSE
+	 * commands (61xx) and sends again a case 2 command with the correct
+	 * Le (6Cxx) so that the application gets the complete response */
+	RESPONSECODE return_value;
+	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
+	unsigned char cmd[5];
+	unsigned char *tx = tx_buffer;
+	unsigned int tx_len = tx_length;
+	unsigned int offset = 0;	/* data already received */
+	unsigned int length;
+	unsigned char sw1, sw2;
+	bool le_corrected = false;
+
+	for (;;)
+	{
+		length = *rx_length - offset;
+		if (CCID_CLASS_CHARACTER == (ccid_descriptor->dwFeatures & CCID_CLASS_EXCHANGE_MASK))
+			return_value = CmdXfrBlockCHAR_T0(ccid_reader, tx_len, tx,
+				&length, rx_buffer + offset, timeout);
+		else
+			return_value = CmdXfrBlockTPDU_T0(ccid_reader, tx_len, tx,
+				&length, rx_buffer + offset, timeout);
+		if (return_value != IFD_SUCCESS)
+			return return_value;
+
+		/* no status word */
+		if (length < 2)
+			break;
+
+		sw1 = rx_buffer[offset + length - 2];
+		sw2 = rx_buffer[offset + length - 1];
+
+		/* wrong Le: send the case 2 command again with Le = SW2 */
+		if ((0x6C == sw1) && (2 == length) && (5 == tx_len) && !le_corrected)
+		{
+			DEBUG_COMM2("T=0: Le corrected to %d", sw2);
+			if (tx != cmd)
+			{
+				memcpy(cmd, tx, sizeof cmd);
+				tx = cmd;
+			}
+			cmd[4] = sw2;
+			le_corrected = true;
+			continue;
+		}
+
+		/* more data available: GET RESPONSE */
+		if ((0x61 == sw1)
+			/* the previous GET RESPONSE returned some data */
+			&& ((tx != cmd) || (0xC0 != cmd[1]) || (length > 2)))
+		{
+			unsigned int le = sw2 ? sw2 : 256;
+
+			/* keep the data but not the status word */
+			offset += length - 2;
+			if (*rx_length - offset < 3)
+			{
+				DEBUG_CRITICAL2("T=0: no room for %d more bytes", le);
+				return IFD_ERROR_INSUFFICIENT_BUFFER;
+			}
+
+			/* ask for less data if the buffer is too small. The card
+			 * will send 61xx again */
+			if (le + 2 > *rx_length - offset)
+				le = *rx_length - offset - 2;
+
+			DEBUG_COMM2("T=0: GET RESPONSE of %d bytes", le);
+			cmd[0] = (tx_len > 0) ? tx[0] : 0x00;	/* CLA */
+			cmd[1] = 0xC0;	/* INS: GET RESPONSE */
+			cmd[2] = 0x00;
+			cmd[3] = 0x00;
+			cmd[4] = le & 0xFF;	/* 256 is encoded as 0 */
+			tx = cmd;
+			tx_len = sizeof cmd;
+			le_corrected = false;
+			continue;
+		}
+
+		break;
+	}
+
+	*rx_length = offset + length;
+
+	return IFD_SUCCESS;
+} /* CmdXfrBlockT0_GetResponse */
+
+
 /*****************************************************************************
  *
  *					T0CmdParsing
@@ -1896,7 +2172,7 @@ static RESPONSECODE T0ProcACK(CcidDesc * ccid_reader,
 	unsigned char **snd_buf, unsigned int *snd_len,
 	unsigned char **rcv_buf, unsigned int *rcv_len,
 	unsigned char **in_buf, unsigned int *in_len,
-	unsigned int proc_len, int is_rcv)
+	unsigned int proc_len, int is_rcv, unsigned int timeout)
 {
 	RESPONSECODE return_value;
 	unsigned int ret_len;
@@ -1958,7 +2234,7 @@ static RESPONSECODE T0ProcACK(CcidDesc * ccid_reader,
 			return_value = CCID_Transmit(ccid_reader, 0, *snd_buf, ret_len, 0);
 			if (return_value != IFD_SUCCESS)
 				return return_value;
-			return_value = CCID_Receive(ccid_reader, &ret_len, tmp_buf, NULL);
+			return_value = CCID_Receive(ccid_reader, &ret_len, tmp_buf, NULL, timeout);
 			if (return_value != IFD_SUCCESS)
 				return return_value;
 
@@ -1967,7 +2243,7 @@ static RESPONSECODE T0ProcACK(CcidDesc * ccid_reader,
 			if (return_value != IFD_SUCCESS)
 				return return_value;
 			return_value = CCID_Receive(ccid_reader, &ret_len, &tmp_buf[1],
-					NULL);
+					NULL, timeout);
 			if (return_value != IFD_SUCCESS)
 				return return_value;
 
@@ -1981,7 +2257,7 @@ static RESPONSECODE T0ProcACK(CcidDesc * ccid_reader,
 			if (return_value != IFD_SUCCESS)
 				return return_value;
 
-			return_value = CCID_Receive(ccid_reader, &ret_len, tmp_buf, NULL);
+			return_value = CCID_Receive(ccid_reader, &ret_len, tmp_buf, NULL, timeout);
 			if (return_value != IFD_SUCCESS)
 				return return_value;
 		}
@@ -2025,7 +2301,7 @@ static RESPONSECODE T0ProcACK(CcidDesc * ccid_reader,
  ****************************************************************************/
 static RESPONSECODE T0ProcSW1(CcidDesc * ccid_reader,
 	unsigned char *rcv_buf, unsigned int *rcv_len,
-	unsigned char *in_buf, unsigned int in_len)
+	unsigned char *in_buf, unsigned int in_len, unsigned int timeout)
 {
 	RESPONSECODE return_value = IFD_SUCCESS;
 	UCHAR tmp_buf[512] = { 0 };
@@ -2047,7 +2323,7 @@ static RESPONSECODE T0ProcSW1(CcidDesc * ccid_reader,
 
 		in_len = 1;
 
-		return_value = CCID_Receive(ccid_reader, &in_len, tmp_buf, NULL);
+		return_value = CCID_Receive(ccid_reader, &in_len, tmp_buf, NULL, timeout);
 		if (return_value != IFD_SUCCESS)
 			return return_value;
 
@@ -2074,7 +2350,7 @@ static RESPONSECODE T0ProcSW1(CcidDesc * ccid_reader,
  ****************************************************************************/
 static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 	unsigned int snd_len, unsigned char snd_buf[], unsigned int *rcv_len,
-	unsigned char rcv_buf[])
+	unsigned char rcv_buf[], unsigned int timeout)
 {
 	int is_rcv;
 	unsigned char cmd[5];
@@ -2121,7 +2397,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 
 		/* wait for ready */
 		pcbuffer[0] = 0;
-		return_value = CmdGetSlotStatus(ccid_reader, pcbuffer);
+		return_value = CmdGetSlotStatus(ccid_reader, pcbuffer, timeout);
 		if (return_value != IFD_SUCCESS)
 			return return_value;
 
@@ -2139,13 +2415,13 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 			{
 				/* read apdu data */
 				return_value = CCID_Receive(ccid_reader, rcv_len, rcv_buf,
-						NULL);
+						NULL, timeout);
 				if (return_value != IFD_SUCCESS)
 					return return_value;
 			}
 		}
 
-		return_value = CmdGetSlotStatus(ccid_reader, pcbuffer);
+		return_value = CmdGetSlotStatus(ccid_reader, pcbuffer, timeout);
 		if (return_value != IFD_SUCCESS)
 			return return_value;
 
@@ -2160,7 +2436,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 			*rcv_len = 2;
 
 			return_value = CCID_Receive(ccid_reader, rcv_len,
-				rcv_buf + backup_len, NULL);
+				rcv_buf + backup_len, NULL, timeout);
 			if (return_value != IFD_SUCCESS)
 				DEBUG_CRITICAL("CCID_Receive failed");
 
@@ -2219,7 +2495,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 		if (in_len == 0)
 		{
 			in_len = 1;
-			return_value = CCID_Receive(ccid_reader, &in_len, tmp_buf, NULL);
+			return_value = CCID_Receive(ccid_reader, &in_len, tmp_buf, NULL, timeout);
 			if (return_value != IFD_SUCCESS)
 			{
 				DEBUG_CRITICAL("CCID_Receive failed");
@@ -2252,10 +2528,10 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 			in_buf++, in_len--;
 			if (is_rcv)
 				return_value = T0ProcACK(ccid_reader, &snd_buf, &snd_len,
-					&rcv_buf, rcv_len, &in_buf, &in_len, exp_len - *rcv_len, 1);
+					&rcv_buf, rcv_len, &in_buf, &in_len, exp_len - *rcv_len, 1, timeout);
 			else
 				return_value = T0ProcACK(ccid_reader, &snd_buf, &snd_len,
-					&rcv_buf, rcv_len, &in_buf, &in_len, snd_len, 0);
+					&rcv_buf, rcv_len, &in_buf, &in_len, snd_len, 0, timeout);
 
 			if (*rcv_len == exp_len)
 				return return_value;
@@ -2267,7 +2543,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 			/* ACK => To transfer 1 remaining bytes */
 			in_buf++, in_len--;
 			return_value = T0ProcACK(ccid_reader, &snd_buf, &snd_len,
-				&rcv_buf, rcv_len, &in_buf, &in_len, 1, is_rcv);
+				&rcv_buf, rcv_len, &in_buf, &in_len, 1, is_rcv, timeout);
 
 			if (return_value != IFD_SUCCESS)
 				return return_value;
@@ -2276,7 +2552,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
 		}
 		else if ((*in_buf & 0xF0) == 0x60 || (*in_buf & 0xF0) == 0x90)
 			/* SW1 */
-			return T0ProcSW1(ccid_reader, rcv_buf, rcv_len, in_buf, in_len);
+			return T0ProcSW1(ccid_reader, rcv_buf, rcv_len, in_buf, in_len, timeout);
 
 		/* Error, unrecognized situation found */
 		DEBUG_CRITICAL2("Unrecognized Procedure byte (0x%02X) found!", *in_buf);
@@ -2295,7 +2571,7 @@ static RESPONSECODE CmdXfrBlockCHAR_T0(CcidDesc * ccid_reader,
  ****************************************************************************/
 static RESPONSECODE CmdXfrBlockTPDU_T1(CcidDesc * ccid_reader,
 	unsigned int tx_length, unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[])
+	unsigned char rx_buffer[], unsigned int timeout)
 {
 	RESPONSECODE return_value = IFD_SUCCESS;
 	int ret;
@@ -2304,7 +2580,7 @@ static RESPONSECODE CmdXfrBlockTPDU_T1(CcidDesc * ccid_reader,
 
 	ret = t1_transceive(&ccid_reader->t1,
 		ccid_reader->t1.nad,
-		tx_buffer, tx_length, rx_buffer, *rx_length);
+		tx_buffer, tx_length, rx_buffer, *rx_length, timeout);
 
 	if (ret < 0)
 		return_value = IFD_COMMUNICATION_ERROR;
@@ -2344,7 +2620,8 @@ RESPONSECODE SetParameters(CcidDesc * ccid_reader, char protocol,
 	CHECK_STATUS(res)
 
 	length = sizeof(cmd);
-	res = ReadPort(ccid_reader, &length, cmd, bSeq);
+	res = ReadPort(ccid_reader, &length, cmd, bSeq,
+		ccid_descriptor->readTimeout);
 	CHECK_STATUS(res)
 
 	if (length < CCID_RESPONSE_HEADER_SIZE)
@@ -2370,6 +2647,69 @@ RESPONSECODE SetParameters(CcidDesc * ccid_reader, char protocol,
 } /* SetParameters */
 
 
+/*****************************************************************************
+ *
+ *					SetDataRateAndClockFrequency
+ *
+ ****************************************************************************/
+RESPONSECODE SetDataRateAndClockFrequency(CcidDesc * ccid_reader,
+	unsigned int *clock, unsigned int *data_rate)
+{
+	unsigned char cmd[CCID_HEADER_SIZE + 8];	/* CCID + clock + data rate */
+	unsigned int length;
+	int bSeq;
+	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
+	status_t res;
+
+	DEBUG_COMM3("clock: %d kHz, data rate: %d bps", *clock, *data_rate);
+
+	bSeq = (*ccid_descriptor->pbSeq)++;
+	cmd[0] = PC_to_RDR_SetDataRateAndClockFrequency;
+	i2dw(8, cmd+1);	/* dwLength */
+	cmd[5] = ccid_descriptor->bCurrentSlotIndex;	/* slot number */
+	cmd[6] = bSeq;
+	cmd[7] = cmd[8] = cmd[9] = 0; /* RFU */
+	i2dw(*clock, cmd+10);	/* dwClockFrequency */
+	i2dw(*data_rate, cmd+14);	/* dwDataRate */
+
+	res = WritePort(ccid_reader, sizeof(cmd), cmd);
+	CHECK_STATUS(res)
+
+	length = sizeof(cmd);
+	res = ReadPort(ccid_reader, &length, cmd, bSeq,
+		ccid_descriptor->readTimeout);
+	CHECK_STATUS(res)
+
+	if (length < CCID_RESPONSE_HEADER_SIZE)
+	{
+		DEBUG_CRITICAL2("Not enough data received: %d bytes", length);
+		return IFD_COMMUNICATION_ERROR;
+	}
+
+	if (cmd[STATUS_OFFSET] & CCID_COMMAND_FAILED)
+	{
+		ccid_error(PCSC_LOG_ERROR, cmd[ERROR_OFFSET], __FILE__, __LINE__, __FUNCTION__);	/* bError */
+		if (0x00 == cmd[ERROR_OFFSET])	/* command not supported */
+			return IFD_NOT_SUPPORTED;
+		else
+			return IFD_COMMUNICATION_ERROR;
+	}
+
+	if (length < sizeof(cmd))
+	{
+		DEBUG_CRITICAL2("Not enough data received: %d bytes", length);
+		return IFD_COMMUNICATION_ERROR;
+	}
+
+	/* values really used by the reader */
+	*clock = dw2i(cmd, 10);
+	*data_rate = dw2i(cmd, 14);
+	DEBUG_COMM3("clock: %d kHz, data rate: %d bps", *clock, *data_rate);
+
+	return IFD_SUCCESS;
+} /* SetDataRateAndClockFrequency */
+
+
 /*****************************************************************************
  *
  *					isCharLevel
@@ -2381,6 +2721,36 @@ int isCharLevel(CcidDesc * ccid_reader)
 } /* isCharLevel */
 
 
+#ifndef TWIN_SERIAL
+/*****************************************************************************
+ *
+ *					ICCD_Wait
+ *
+ ****************************************************************************/
+static unsigned int ICCD_Wait(_ccid_descriptor *ccid_descriptor,
+	unsigned int wait, unsigned int max_wait)
+{
+	struct timespec start, end;
+
+	if (wait > max_wait)
+		wait = max_wait;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	(void)usleep(wait);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ccid_descriptor->iccdWaitCount++;
+	ccid_descriptor->iccdWaitTime += (end.tv_sec - start.tv_sec) * 1000000LL
+		+ (end.tv_nsec - start.tv_nsec) / 1000;
+	DEBUG_PERIODIC3("waited %u us, total: %llu us", wait,
+		ccid_descriptor->iccdWaitTime);
+
+	/* exponential backoff for the next wait */
+	return wait * 2;
+} /* ICCD_Wait */
+
+
+#endif
 /*****************************************************************************
  *
  *					i2dw
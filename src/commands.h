@@ -27,7 +27,8 @@
 #define CCID_RESPONSE_HEADER_SIZE CCID_HEADER_SIZE
 
 RESPONSECODE CmdPowerOn(CcidDesc * ccid_reader, unsigned int * nlength,
-	/*@out@*/ unsigned char buffer[], int voltage);
+	/*@out@*/ unsigned char buffer[], int *voltage, bool fallback,
+	unsigned int timeout);
 
 RESPONSECODE SecurePINVerify(CcidDesc * ccid_slot,
 	unsigned char TxBuffer[], unsigned int TxLength,
@@ -48,20 +49,38 @@ RESPONSECODE CmdEscapeCheck(CcidDesc * ccid_reader,
 
 RESPONSECODE CmdPowerOff(CcidDesc * ccid_reader);
 
+RESPONSECODE CmdAbort(CcidDesc * ccid_reader);
+
 RESPONSECODE CmdGetSlotStatus(CcidDesc * ccid_reader,
-	/*@out@*/ unsigned char buffer[static SIZE_GET_SLOT_STATUS]);
+	/*@out@*/ unsigned char buffer[static SIZE_GET_SLOT_STATUS],
+	unsigned int timeout);
 
 RESPONSECODE CmdXfrBlock(CcidDesc * ccid_slot, unsigned int tx_length,
 	unsigned char tx_buffer[], unsigned int *rx_length,
-	unsigned char rx_buffer[], int protoccol);
+	unsigned char rx_buffer[], int protoccol, unsigned int timeout);
 
 RESPONSECODE CCID_Transmit(CcidDesc * ccid_reader, unsigned int tx_length,
 	const unsigned char tx_buffer[], unsigned short rx_length, unsigned char bBWI);
 
+/* CCID_HEADER_SIZE bytes must be available before tx_buffer: the CCID
+ * header is written there */
+RESPONSECODE CCID_TransmitInPlace(CcidDesc * ccid_reader,
+	unsigned int tx_length, unsigned char tx_buffer[],
+	unsigned short rx_length, unsigned char bBWI);
+
 RESPONSECODE CCID_Receive(CcidDesc * ccid_reader,
 	/*@out@*/ unsigned int *rx_length,
-	/*@out@*/ unsigned char rx_buffer[], unsigned char *chain_parameter);
+	/*@out@*/ unsigned char rx_buffer[], unsigned char *chain_parameter,
+	unsigned int timeout);
+
+/* CCID_HEADER_SIZE bytes must be available before rx_buffer: the CCID
+ * header is received there */
+RESPONSECODE CCID_ReceiveInPlace(CcidDesc * ccid_reader,
+	/*@out@*/ unsigned int *rx_length,
+	/*@out@*/ unsigned char rx_buffer[], unsigned int timeout);
 
+RESPONSECODE SetDataRateAndClockFrequency(CcidDesc * ccid_reader,
+	unsigned int *clock, unsigned int *data_rate);
 RESPONSECODE SetParameters(CcidDesc * ccid_reader, char protocol,
 	unsigned int length, unsigned char buffer[]);
 
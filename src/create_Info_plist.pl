@@ -1,7 +1,8 @@
 #!/usr/bin/env perl
 
 #    create_Info_plist.pl: generate Info.plist from a template and a
-#    list of supported readers
+#    list of supported readers, or with --reader-db a C array of the
+#    supported readers sorted by vendor and product IDs
 #
 #    Copyright (C) 2004-2024  Ludovic Rousseau  <ludovic.rousseau@free.fr>
 #
@@ -24,7 +25,7 @@ use warnings;
 use strict;
 use Getopt::Long;
 
-my (@vendor, @product, @name);
+my (@readers, @vendor, @product, @name);
 my ($vendor, $product, $name);
 my $target = "libccid.so";
 my $version = "1.0.0";
@@ -32,19 +33,22 @@ my $class = "<key>CFBundleName</key>
 	<string>CCIDCLASSDRIVER</string>";
 my $noclass = 0;
 my $extra_bundle_id = "";
+my $reader_db = 0;
 
 GetOptions(
 	"extra_bundle_id=s" => \$extra_bundle_id,
 	"target=s" => \$target,
 	"version=s" => \$version,
-	"no-class" => \$noclass);
+	"no-class" => \$noclass,
+	"reader-db" => \$reader_db);
 
-if ($#ARGV < 1)
+if (($#ARGV < 1) && !($reader_db && $#ARGV == 0))
 {
 	print "usage: $0 supported_readers.txt Info.plist
 	--extra_bundle_id=$extra_bundle_id
 	--target=$target
-	--version=$version\n";
+	--version=$version
+   or: $0 --reader-db supported_readers.txt\n";
 	exit;
 }
 
@@ -57,12 +61,41 @@ while (<IN>)
 	chomp;
 	($vendor, $product, $name) = split /:/;
 	# print "m: $vendor, p: $product, n: $name\n";
+	push @readers, [$vendor, $product, $name];
+}
+close IN;
+
+if ($reader_db)
+{
+	# keep the position to sort aliases in the file order
+	my @sorted = sort {
+		hex($readers[$a][0]) <=> hex($readers[$b][0])
+			or hex($readers[$a][1]) <=> hex($readers[$b][1])
+			or $a <=> $b
+		} 0 .. $#readers;
+
+	print "/* generated by create_Info_plist.pl. DO NOT EDIT BY HAND */\n\n";
+	print "static const struct readerDbEntry reader_db[] =\n{\n";
+	foreach my $i (@sorted)
+	{
+		($vendor, $product, $name) = @{$readers[$i]};
+		$name =~ s/\\/\\\\/g;
+		$name =~ s/"/\\"/g;
+		printf "\t{ 0x%04X, 0x%04X, \"%s\" },\n", hex($vendor), hex($product),
+			$name;
+	}
+	print "};\n";
+	exit;
+}
+
+foreach my $reader (@readers)
+{
+	($vendor, $product, $name) = @$reader;
 	push @vendor, $vendor;
 	push @product, $product;
 	$name =~ s/&/&amp;/g;
 	push @name, $name
 }
-close IN;
 
 map { $_ = "\t\t<string>$_</string>\n" } @vendor;
 map { $_ = "\t\t<string>$_</string>\n" } @product;
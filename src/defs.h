@@ -83,6 +83,11 @@ typedef struct _ccid_descriptor
 	 */
 	int dwDefaultClock;
 
+	/*
+	 * Max Clock
+	 */
+	int dwMaximumClock;
+
 	/*
 	 * Max Data Rate
 	 */
@@ -108,6 +113,11 @@ typedef struct _ccid_descriptor
 	 */
 	unsigned int *arrayOfSupportedDataRates;
 
+	/*
+	 * The array of clock frequencies supported by the reader
+	 */
+	unsigned int *arrayOfSupportedClocks;
+
 	/*
 	 * Read communication port timeout
 	 * value is milliseconds
@@ -182,6 +192,15 @@ typedef struct _ccid_descriptor
 	bool zlp;
 #endif
 
+#ifndef TWIN_SERIAL
+	/*
+	 * ICCD busy and polling waits: number of waits and total time
+	 * in microseconds
+	 */
+	unsigned int iccdWaitCount;
+	unsigned long long iccdWaitTime;
+#endif
+
 #ifdef SEC1210_SYNC
 	struct _sec1210_cond * sec1210_shared;
 	struct _ccid_descriptor *sec1210_other_interface;
@@ -250,13 +269,62 @@ typedef _serialDevice _Device;
 
 #include <libusb.h>
 
+/* preallocated libusb transfer */
+struct usbTransfer
+{
+	struct libusb_transfer *transfer;
+	unsigned char *buffer;
+	int length;
+
+	/* buffer allocated using libusb_dev_mem_alloc() */
+	bool dev_mem;
+
+	/* set by the transfer callback and signaled using condition */
+	int completed;
+
+	/* set by abort_transfer() to stop waiting for the transfer */
+	bool aborted;
+	pthread_mutex_t mutex;
+	pthread_cond_t condition;
+};
+
+/* frame received by Multi_ReadProc() */
+struct multiSlotFrame
+{
+	struct multiSlotFrame *next;
+	int size;
+	unsigned char buffer[];
+};
+
+/* card presence tracked using the RDR_to_PC_NotifySlotChange
+ * notifications (see InterruptGetPresence()) */
+struct slotPresence
+{
+	int state;
+	/* number of notifications received */
+	unsigned int events;
+};
+
 struct multiSlot_ConcurrentAccess
 {
-	unsigned char buffer[10 + MAX_BUFFER_SIZE_EXTENDED];
+	/* frame received for this slot, taken from the frames pool */
+	struct multiSlotFrame *frame;
 	int length;
 
 	pthread_mutex_t slot_mutex;
 	pthread_cond_t slot_condition;
+
+	/* bSeq of the last command sent to this slot */
+	unsigned char bSeq;
+
+	/* a command is in progress on this slot, protected by busy_mutex */
+	bool busy;
+
+	/* card event for this slot, protected by the extension mutex */
+	pthread_cond_t interrupt_condition;
+	bool interrupt;
+	int interrupt_status;
+	struct slotPresence presence;
 };
 
 struct usbDevice_MultiSlot_Extension
@@ -265,15 +333,28 @@ struct usbDevice_MultiSlot_Extension
 
 	/* The multi-threaded polling part */
 	_Atomic bool terminated;
-	int status;
-	unsigned char buffer[CCID_INTERRUPT_SIZE];
 	pthread_t thread_proc;
 	pthread_mutex_t mutex;
-	pthread_cond_t condition;
 
 	pthread_t thread_concurrent;
 	struct multiSlot_ConcurrentAccess *concurrent;
+	/* number of slots with a command in progress
+	 * limited to bMaxCCIDBusySlots */
+	int busy_slots;
+	int max_busy_slots;
+	pthread_mutex_t busy_mutex;
+	pthread_cond_t busy_condition;
+
+	/* bulk-IN transfer of Multi_ReadProc() submitted
+	 * protected by polling_transfer_mutex of the first slot */
+	bool read_submitted;
 	libusb_device_handle *dev_handle;
+
+	/* frame buffers exchanged between Multi_ReadProc() and the slots
+	 * frame_size is dwMaxCCIDMessageLength rounded up */
+	struct multiSlotFrame *free_frames;
+	int frame_size;
+	pthread_mutex_t frames_mutex;
 };
 
 typedef struct
@@ -305,6 +386,17 @@ typedef struct
 	struct libusb_transfer *polling_transfer;
 	/* whether the polling should be terminated */
 	bool terminate_requested;
+	/* card presence, protected by polling_transfer_mutex */
+	struct slotPresence presence;
+
+	/*
+	 * Preallocated transfers
+	 * write_transfer is used by this slot only
+	 * read_transfer and interrupt_transfer are shared by all the slots
+	 */
+	struct usbTransfer *write_transfer;
+	struct usbTransfer *read_transfer;
+	struct usbTransfer *interrupt_transfer;
 
 	/* pointer to the multislot extension (if any) */
 	struct usbDevice_MultiSlot_Extension *multislot_extension;
@@ -334,6 +426,41 @@ typedef struct CCID_DESC
 	 */
 	unsigned char bPowerFlags;
 
+	/*
+	 * Voltage of the last successful power up, tried first at the next
+	 * one. Forgotten when the card is removed
+	 */
+	int learnedVoltage;
+
+	/*
+	 * Last successful IFDHSetProtocolParameters(), replayed without
+	 * parsing the ATR again when the same card asks for the same
+	 * protocol and PTS values
+	 */
+	struct
+	{
+		bool valid;
+		/* no power up or reset since the negotiation */
+		bool applied;
+
+		/* request */
+		int nATRLength;
+		unsigned char pcATRBuffer[MAX_ATR_SIZE];
+		DWORD requestedProtocol;
+		unsigned char flags, pts1, pts2, pts3;
+
+		/* result */
+		DWORD protocol;
+		bool pps_sent;
+		unsigned char pps[6];	/* PPS_MAX_LENGTH */
+		unsigned char abProtocolDataStructure[7];
+		unsigned int dwLength;
+		unsigned int readTimeout;
+		unsigned int clock, data_rate;	/* 0 if not changed */
+		int t1_checksum;
+		int ifsc;
+	} negotiated;
+
 	/*
 	 * T=1 Protocol context
 	 */
@@ -399,7 +526,9 @@ typedef enum {
 #define OpenPort OpenSerial
 #define ClosePort CloseSerial
 #define ReadPort ReadSerial
+#define ReadvPort ReadvSerial
 #define WritePort WriteSerial
+#define WritevPort WritevSerial
 #define DisconnectPort DisconnectSerial
 #include "ccid_serial.h"
 
@@ -409,7 +538,9 @@ typedef enum {
 #define OpenPort OpenUSB
 #define ClosePort CloseUSB
 #define ReadPort ReadUSB
+#define ReadvPort ReadvUSB
 #define WritePort WriteUSB
+#define WritevPort WritevUSB
 #define DisconnectPort DisconnectUSB
 #include "ccid_usb.h"
 
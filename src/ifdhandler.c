@@ -63,6 +63,13 @@ static unsigned int T0_card_timeout(double f, double d, int TC1, int TC2,
 static unsigned int T1_card_timeout(double f, double d, int TC1, int BWI,
 	int CWI, int clock_frequency);
 static int get_IFSC(ATR_t *atr, int *i);
+static RESPONSECODE run_apdu_script(CcidDesc * ccid_reader,
+	PUCHAR TxBuffer, DWORD TxLength, PUCHAR RxBuffer, DWORD RxLength,
+	PDWORD pdwBytesReturned);
+static void set_max_clock_and_data_rate(CcidDesc * ccid_reader,
+	ATR_t *atr, BYTE fidi);
+static RESPONSECODE replay_negotiation(CcidDesc * ccid_reader);
+static void learn_voltage(CcidDesc * ccid_reader, int voltage);
 
 static void FreeChannel(CcidDesc * ccid_reader)
 {
@@ -117,6 +124,11 @@ static RESPONSECODE CreateChannelByNameOrChannel(DWORD Lun,
 	/* Reset PowerFlags */
 	ccid_reader->bPowerFlags = POWERFLAGS_RAZ;
 
+	/* nothing learned yet */
+	ccid_reader->learnedVoltage = VOLTAGE_AUTO;
+	ccid_reader->negotiated.valid = false;
+	ccid_reader->negotiated.applied = false;
+
 	/* reader name */
 	if (lpcDevice)
 		ccid_reader->readerName = strdup(lpcDevice);
@@ -149,7 +161,7 @@ static RESPONSECODE CreateChannelByNameOrChannel(DWORD Lun,
 	else
 	{
 		unsigned char pcbuffer[SIZE_GET_SLOT_STATUS];
-		unsigned int oldReadTimeout;
+		unsigned int resyncTimeout;
 		RESPONSECODE cmd_ret;
 		_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
 
@@ -163,24 +175,22 @@ static RESPONSECODE CreateChannelByNameOrChannel(DWORD Lun,
 		 * few tries. It is an empirical hack */
 
 		/* The reader may have to start here so give it some time */
-		cmd_ret = CmdGetSlotStatus(ccid_reader, pcbuffer);
+		cmd_ret = CmdGetSlotStatus(ccid_reader, pcbuffer,
+			ccid_descriptor->readTimeout);
 		if (IFD_NO_SUCH_DEVICE == cmd_ret)
 		{
 			return_value = cmd_ret;
 			goto error;
 		}
 
-		/* save the current read timeout computed from card capabilities */
-		oldReadTimeout = ccid_descriptor->readTimeout;
-
 		/* 100 ms just to resync the USB toggle bits */
 		/* Do not use a fixed 100 ms value but compute it from the
 		 * default timeout. It is now possible to use a different value
 		 * by changing readTimeout in ccid_open_hack_pre() */
-		ccid_descriptor->readTimeout = ccid_descriptor->readTimeout * 100.0 / DEFAULT_COM_READ_TIMEOUT;
+		resyncTimeout = ccid_descriptor->readTimeout * 100.0 / DEFAULT_COM_READ_TIMEOUT;
 
-		if ((IFD_COMMUNICATION_ERROR == CmdGetSlotStatus(ccid_reader, pcbuffer))
-			&& (IFD_COMMUNICATION_ERROR == CmdGetSlotStatus(ccid_reader, pcbuffer)))
+		if ((IFD_COMMUNICATION_ERROR == CmdGetSlotStatus(ccid_reader, pcbuffer, resyncTimeout))
+			&& (IFD_COMMUNICATION_ERROR == CmdGetSlotStatus(ccid_reader, pcbuffer, resyncTimeout)))
 		{
 			DEBUG_CRITICAL("failed");
 			return_value = IFD_COMMUNICATION_ERROR;
@@ -194,9 +204,6 @@ static RESPONSECODE CreateChannelByNameOrChannel(DWORD Lun,
 				DEBUG_CRITICAL("failed");
 			}
 		}
-
-		/* set back the old timeout */
-		ccid_descriptor->readTimeout = oldReadTimeout;
 	}
 
 error:
@@ -285,6 +292,13 @@ EXTERNAL RESPONSECODE IFDHCloseChannel(DWORD Lun)
 	(void)CmdPowerOff(ccid_reader);
 	/* No reader status check, if it failed, what can you do ? :) */
 
+#ifndef TWIN_SERIAL
+	if (ccid_reader->device.ccid.iccdWaitCount)
+		DEBUG_INFO3("ICCD waits: %u, total: %llu ms",
+			ccid_reader->device.ccid.iccdWaitCount,
+			ccid_reader->device.ccid.iccdWaitTime / 1000);
+#endif
+
 	FreeChannel(ccid_reader);
 
 	return IFD_SUCCESS;
@@ -524,6 +538,12 @@ EXTERNAL RESPONSECODE IFDHGetCapabilities(DWORD Lun, DWORD Tag,
 				*Length = 1;
 				if (ccid_desc->bMaxSlotIndex +1 == ccid_desc->bMaxCCIDBusySlots)
 					*Value = 1; /* all slots can be used simultanesously */
+#ifndef TWIN_SERIAL
+				else if (ccid_reader->device.multislot_extension)
+					/* the number of busy slots is limited to
+					 * bMaxCCIDBusySlots by WriteUSB() */
+					*Value = 1;
+#endif
 				else
 					*Value = 0; /* Can NOT talk to multiple slots at the same time */
 			}
@@ -784,6 +804,8 @@ EXTERNAL RESPONSECODE IFDHSetProtocolParameters(DWORD Lun, DWORD Protocol,
 	unsigned int len;
 	int convention;
 	int atr_ret;
+	bool cacheable = true;
+	DWORD requestedProtocol;
 
 	/* Set ccid desc params */
 	_ccid_descriptor *ccid_desc;
@@ -799,6 +821,8 @@ EXTERNAL RESPONSECODE IFDHSetProtocolParameters(DWORD Lun, DWORD Protocol,
 	DEBUG_INFO4("protocol T=" DWORD_D ", " LOG_STRING " (lun: " DWORD_X ")",
 		Protocol-SCARD_PROTOCOL_T0, ccid_reader->readerName, Lun);
 
+	requestedProtocol = Protocol;
+
 	/* Set to zero buffer */
 	memset(pps, 0, sizeof(pps));
 	memset(&atr, 0, sizeof(atr));
@@ -814,6 +838,24 @@ EXTERNAL RESPONSECODE IFDHSetProtocolParameters(DWORD Lun, DWORD Protocol,
 		return IFD_ERROR_NOT_SUPPORTED;
 	}
 
+	/* same card, same protocol and same PTS values as the last time? */
+	if (ccid_reader->negotiated.valid
+		&& (ccid_reader->negotiated.nATRLength == ccid_reader->nATRLength)
+		&& (0 == memcmp(ccid_reader->negotiated.pcATRBuffer,
+			ccid_reader->pcATRBuffer, ccid_reader->nATRLength))
+		&& (ccid_reader->negotiated.requestedProtocol == Protocol)
+		&& (ccid_reader->negotiated.flags == Flags)
+		&& (ccid_reader->negotiated.pts1 == PTS1)
+		&& (ccid_reader->negotiated.pts2 == PTS2)
+		&& (ccid_reader->negotiated.pts3 == PTS3))
+		return replay_negotiation(ccid_reader);
+
+	/* forget the previous negotiation until this one succeeds */
+	ccid_reader->negotiated.valid = false;
+	ccid_reader->negotiated.pps_sent = false;
+	ccid_reader->negotiated.clock = 0;
+	ccid_reader->negotiated.data_rate = 0;
+
 	/* Get ATR of the card */
 	atr_ret = ATR_InitFromArray(&atr, ccid_reader->pcATRBuffer,
 		ccid_reader->nATRLength);
@@ -1034,11 +1076,18 @@ EXTERNAL RESPONSECODE IFDHSetProtocolParameters(DWORD Lun, DWORD Protocol,
 			}
 			else
 #endif
-			if (PPS_Exchange(ccid_reader, pps, &len, &pps[2]) != PPS_OK)
 			{
-				DEBUG_INFO1("PPS_Exchange Failed");
+				/* keep the request for a replay */
+				memcpy(ccid_reader->negotiated.pps, pps,
+					sizeof ccid_reader->negotiated.pps);
+				ccid_reader->negotiated.pps_sent = true;
 
-				return IFD_ERROR_PTS_FAILURE;
+				if (PPS_Exchange(ccid_reader, pps, &len, &pps[2]) != PPS_OK)
+				{
+					DEBUG_INFO1("PPS_Exchange Failed");
+
+					return IFD_ERROR_PTS_FAILURE;
+				}
 			}
 		}
 	}
@@ -1137,6 +1186,10 @@ end:
 
 		DEBUG_COMM2("Timeout: %d ms", ccid_desc->readTimeout);
 
+		memcpy(ccid_reader->negotiated.abProtocolDataStructure, param,
+			sizeof(param));
+		ccid_reader->negotiated.dwLength = sizeof(param);
+
 		if (ccid_desc->dwFeatures & CCID_CLASS_AUTO_PPS_PROP)
 			DEBUG_COMM("Skip SetParameters");
 		else
@@ -1153,6 +1206,9 @@ end:
 					DWORD atr2length;
 					RESPONSECODE ret2;
 
+					/* a replay would fail the same way */
+					cacheable = false;
+
 					/* 1st (cold?) reset */
 					ret2 = IFDHPowerICC(Lun, IFD_RESET, atr2, &atr2length);
 					if (IFD_SUCCESS != ret2)
@@ -1205,6 +1261,10 @@ end:
 
 		DEBUG_COMM2("Timeout: %d ms", ccid_desc->readTimeout);
 
+		memcpy(ccid_reader->negotiated.abProtocolDataStructure, param,
+			sizeof(param));
+		ccid_reader->negotiated.dwLength = sizeof(param);
+
 		if (ccid_desc->dwFeatures & CCID_CLASS_AUTO_PPS_PROP)
 			DEBUG_COMM("Skip SetParameters");
 		else
@@ -1215,6 +1275,12 @@ end:
 		}
 	}
 
+	/* use the highest clock frequency supported by the reader and the card */
+	if ((DriverOptions & DRIVER_OPTION_MAX_CLOCK_AND_DATA_RATE)
+		&& ! (ccid_desc->dwFeatures & CCID_CLASS_AUTO_PPS_PROP))
+		set_max_clock_and_data_rate(ccid_reader, &atr,
+			ccid_reader->negotiated.abProtocolDataStructure[0]);
+
 	/* set IFSC & IFSD in T=1 */
 	if ((SCARD_PROTOCOL_T1 == Protocol)
 		&& (CCID_CLASS_TPDU == (ccid_desc->dwFeatures & CCID_CLASS_EXCHANGE_MASK)))
@@ -1233,7 +1299,8 @@ end:
 		if (! (ccid_desc->dwFeatures & CCID_CLASS_AUTO_IFSD))
 		{
 			DEBUG_COMM2("Negotiate IFSD at %d", ccid_desc -> dwMaxIFSD);
-			if (t1_negotiate_ifsd(t1, 0, ccid_desc -> dwMaxIFSD) < 0)
+			if (t1_negotiate_ifsd(t1, 0, ccid_desc -> dwMaxIFSD,
+				ccid_desc -> readTimeout) < 0)
 				return IFD_COMMUNICATION_ERROR;
 		}
 		(void)t1_set_param(t1, IFD_PROTOCOL_T1_IFSD, ccid_desc -> dwMaxIFSD);
@@ -1244,6 +1311,28 @@ end:
 	/* store used protocol for use by the secure commands (verify/change PIN) */
 	ccid_desc->cardProtocol = Protocol;
 
+	/* remember the negotiation for the next request of the same card */
+	if (cacheable)
+	{
+		t1_state_t *t1 = &(ccid_reader -> t1);
+
+		ccid_reader->negotiated.nATRLength = ccid_reader->nATRLength;
+		memcpy(ccid_reader->negotiated.pcATRBuffer, ccid_reader->pcATRBuffer,
+			ccid_reader->nATRLength);
+		ccid_reader->negotiated.requestedProtocol = requestedProtocol;
+		ccid_reader->negotiated.flags = Flags;
+		ccid_reader->negotiated.pts1 = PTS1;
+		ccid_reader->negotiated.pts2 = PTS2;
+		ccid_reader->negotiated.pts3 = PTS3;
+		ccid_reader->negotiated.protocol = Protocol;
+		ccid_reader->negotiated.readTimeout = ccid_desc->readTimeout;
+		ccid_reader->negotiated.t1_checksum = (2 == t1->rc_bytes) ?
+			IFD_PROTOCOL_T1_CHECKSUM_CRC : IFD_PROTOCOL_T1_CHECKSUM_LRC;
+		ccid_reader->negotiated.ifsc = t1->ifsc;
+		ccid_reader->negotiated.valid = true;
+		ccid_reader->negotiated.applied = true;
+	}
+
 	return IFD_SUCCESS;
 } /* IFDHSetProtocolParameters */
 
@@ -1291,10 +1380,11 @@ EXTERNAL RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action,
 	RESPONSECODE return_value = IFD_SUCCESS;
 	unsigned char pcbuffer[MAX_ATR_SIZE];
 	CcidDesc * ccid_reader;
+	int voltage;
+	bool power_off_first, warm_reset, same_atr;
 #ifndef NO_LOG
 	const char *actions[] = { "PowerUp", "PowerDown", "Reset" };
 #endif
-	unsigned int oldReadTimeout;
 	_ccid_descriptor *ccid_descriptor;
 
 	/* By default, assume it won't work :) */
@@ -1309,6 +1399,9 @@ EXTERNAL RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action,
 	DEBUG_INFO4("action: " LOG_STRING ", " LOG_STRING " (lun: " DWORD_X ")",
 		actions[Action-IFD_POWER_UP], ccid_reader->readerName, Lun);
 
+	/* the card is back to its default parameters */
+	ccid_reader->negotiated.applied = false;
+
 	switch (Action)
 	{
 		case IFD_POWER_DOWN:
@@ -1336,19 +1429,47 @@ EXTERNAL RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action,
 
 		case IFD_POWER_UP:
 		case IFD_RESET:
-			/* save the current read timeout computed from card capabilities */
 			ccid_descriptor = &ccid_reader->device.ccid;
-			oldReadTimeout = ccid_descriptor->readTimeout;
 
 			/* The German eID card is bogus and need to be powered off
 			 * before a power on */
-			if ((KOBIL_IDTOKEN == ccid_descriptor -> readerID)
+			power_off_first = (KOBIL_IDTOKEN == ccid_descriptor -> readerID)
 #ifdef SEC1210_SYNC
 				/* power down before power up on the Microchip SEC1210
 				 * second interface */
 				|| ((SEC1210 == ccid_descriptor -> readerID) && (1 == ccid_descriptor->sec1210_interface))
 #endif
-				)
+				;
+
+			/* reset of a powered card: the reader performs a warm reset
+			 * with the voltage already in use */
+			warm_reset = (IFD_RESET == Action)
+				&& (ccid_reader->bPowerFlags & MASK_POWERFLAGS_PUP)
+				&& !(ccid_reader->bPowerFlags & MASK_POWERFLAGS_PDWN)
+				&& !power_off_first;
+			if (warm_reset)
+			{
+				DEBUG_COMM("Warm reset");
+				voltage = ccid_reader->learnedVoltage;
+				if (VOLTAGE_AUTO == voltage)
+					voltage = PowerOnVoltage;
+
+				nlength = sizeof(pcbuffer);
+				return_value = CmdPowerOn(ccid_reader, &nlength, pcbuffer,
+					&voltage, false, 60*1000);
+				if (IFD_NO_SUCH_DEVICE == return_value)
+					goto end;
+
+				if (IFD_SUCCESS == return_value)
+					goto powered;
+
+				/* continue with a cold reset */
+				DEBUG_INFO1("Warm reset failed");
+				warm_reset = false;
+				power_off_first = true;
+			}
+
+			if (power_off_first)
 			{
 				/* send the command */
 				if (IFD_SUCCESS != CmdPowerOff(ccid_reader))
@@ -1367,14 +1488,16 @@ EXTERNAL RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action,
 			 * 1 ETU = 372 cycles during ATR
 			 * with a 4 MHz clock => 29 seconds
 			 */
-			ccid_descriptor->readTimeout = 60*1000;
+			/* start with the voltage accepted at the previous power up
+			 * but never with a higher voltage than the configured one */
+			voltage = PowerOnVoltage;
+			if ((VOLTAGE_AUTO != PowerOnVoltage)
+				&& (ccid_reader->learnedVoltage >= PowerOnVoltage))
+				voltage = ccid_reader->learnedVoltage;
 
 			nlength = sizeof(pcbuffer);
 			return_value = CmdPowerOn(ccid_reader, &nlength, pcbuffer,
-				PowerOnVoltage);
-
-			/* set back the old timeout */
-			ccid_descriptor->readTimeout = oldReadTimeout;
+				&voltage, true, 60*1000);
 
 			if (return_value != IFD_SUCCESS)
 			{
@@ -1388,18 +1511,36 @@ EXTERNAL RESPONSECODE IFDHPowerICC(DWORD Lun, DWORD Action,
 				goto end;
 			}
 
+powered:
 			/* Power up successful, set state variable to memorise it */
 			ccid_reader->bPowerFlags |= MASK_POWERFLAGS_PUP;
 			ccid_reader->bPowerFlags &= ~MASK_POWERFLAGS_PDWN;
 
+			if (nlength > MAX_ATR_SIZE)
+				nlength = MAX_ATR_SIZE;
+
+			/* the same card answered the warm reset */
+			same_atr = warm_reset
+				&& ((int)nlength == ccid_reader->nATRLength)
+				&& (0 == memcmp(ccid_reader->pcATRBuffer, pcbuffer, nlength));
+
 			/* Reset is returned, even if TCK is wrong */
-			ccid_reader->nATRLength = *AtrLength =
-				(nlength < MAX_ATR_SIZE) ? nlength : MAX_ATR_SIZE;
+			ccid_reader->nATRLength = *AtrLength = nlength;
 			memcpy(Atr, pcbuffer, *AtrLength);
 			memcpy(ccid_reader->pcATRBuffer, pcbuffer, *AtrLength);
 
-			/* initialise T=1 context */
-			(void)t1_init(&ccid_reader->t1, ccid_reader);
+			learn_voltage(ccid_reader, voltage);
+
+			if (same_atr)
+			{
+				/* the T=1 parameters are deduced from the ATR so only
+				 * the block sequence has to start again */
+				DEBUG_COMM("Same ATR. Keep the T=1 parameters");
+				t1_restart(&ccid_reader->t1);
+			}
+			else
+				/* initialise T=1 context */
+				(void)t1_init(&ccid_reader->t1, ccid_reader);
 			break;
 
 		default:
@@ -1453,8 +1594,7 @@ EXTERNAL RESPONSECODE IFDHTransmitToICC(DWORD Lun, SCARD_IO_HEADER SendPci,
 	RESPONSECODE return_value;
 	unsigned int rx_length;
 	CcidDesc * ccid_reader;
-	int old_read_timeout;
-	bool restore_timeout = false;
+	unsigned int timeout;
 	_ccid_descriptor *ccid_descriptor;
 
 	(void)RecvPci;
@@ -1524,25 +1664,19 @@ EXTERNAL RESPONSECODE IFDHTransmitToICC(DWORD Lun, SCARD_IO_HEADER SendPci,
 	/* Pseudo-APDU as defined in PC/SC v2 part 10 supplement document
 	 * CLA=0xFF, INS=0xC2, P1=0x01 */
 	if (0 == memcmp(TxBuffer, "\xFF\xC2\x01", 3))
-	{
 		/* Yes, use the same timeout as for SCardControl() */
-		restore_timeout = true;
-		old_read_timeout = ccid_descriptor -> readTimeout;
-		ccid_descriptor -> readTimeout = 90 * 1000;	/* 90 seconds */
-	}
+		timeout = 90 * 1000;	/* 90 seconds */
+	else
+		timeout = ccid_descriptor -> readTimeout;
 
 	rx_length = *RxLength;
 	return_value = CmdXfrBlock(ccid_reader, TxLength, TxBuffer, &rx_length,
-		RxBuffer, SendPci.Protocol);
+		RxBuffer, SendPci.Protocol, timeout);
 	if (IFD_SUCCESS == return_value)
 		*RxLength = rx_length;
 	else
 		*RxLength = 0;
 
-	/* restore timeout */
-	if (restore_timeout)
-		ccid_descriptor -> readTimeout = old_read_timeout;
-
 	return return_value;
 } /* IFDHTransmitToICC */
 
@@ -1629,6 +1763,33 @@ EXTERNAL RESPONSECODE IFDHControl(DWORD Lun, DWORD dwControlCode,
 		}
 	}
 
+	if (IOCTL_SMARTCARD_VENDOR_APDU_SCRIPT == dwControlCode)
+		return_value = run_apdu_script(ccid_reader, TxBuffer, TxLength,
+			RxBuffer, RxLength, pdwBytesReturned);
+
+#ifndef TWIN_SERIAL
+	/* ICCD busy and polling waits */
+	if (IOCTL_SMARTCARD_VENDOR_ICCD_WAIT_STATS == dwControlCode)
+	{
+		unsigned int count = ccid_descriptor->iccdWaitCount;
+		unsigned long long total = ccid_descriptor->iccdWaitTime;
+
+		if (RxLength < 12)
+			return_value = IFD_ERROR_INSUFFICIENT_BUFFER;
+		else
+		{
+			/* number of waits on 4 bytes and total time in
+			 * microseconds on 8 bytes, big endian */
+			for (int i=0; i<4; i++)
+				RxBuffer[i] = count >> (8 * (3 - i));
+			for (int i=0; i<8; i++)
+				RxBuffer[4 + i] = total >> (8 * (7 - i));
+			*pdwBytesReturned = 12;
+			return_value = IFD_SUCCESS;
+		}
+	}
+#endif
+
 	/* Implement the PC/SC v2.02.07 Part 10 IOCTL mechanism */
 
 	/* Query for features */
@@ -2099,7 +2260,9 @@ EXTERNAL RESPONSECODE IFDHICCPresence(DWORD Lun)
 	int oldLogLevel;
 	CcidDesc * ccid_reader;
 	_ccid_descriptor *ccid_descriptor;
-	unsigned int oldReadTimeout;
+#ifndef TWIN_SERIAL
+	unsigned int presence_events;
+#endif
 
 	(void)pthread_mutex_lock(&ifdh_context_mutex);
 	ccid_reader = LunToCcidDesc(Lun);
@@ -2135,21 +2298,35 @@ EXTERNAL RESPONSECODE IFDHICCPresence(DWORD Lun)
 	}
 #endif
 
-	/* save the current read timeout computed from card capabilities */
-	oldReadTimeout = ccid_descriptor->readTimeout;
+#ifndef TWIN_SERIAL
+	/* card movements notified by the interrupt endpoint */
+	return_value = InterruptGetPresence(ccid_reader, &presence_events);
+	if (IFD_ICC_PRESENT == return_value)
+		goto slot_status;
 
-	/* use default timeout since the reader may not be present anymore */
-	ccid_descriptor->readTimeout = DEFAULT_COM_READ_TIMEOUT;
+	if (IFD_ICC_NOT_PRESENT == return_value)
+	{
+		/* Reset ATR buffer */
+		ccid_reader->nATRLength = 0;
+		*ccid_reader->pcATRBuffer = '\0';
+
+		/* Reset PowerFlags */
+		ccid_reader->bPowerFlags = POWERFLAGS_RAZ;
+
+		/* the next card may not accept the same voltage */
+		ccid_reader->learnedVoltage = VOLTAGE_AUTO;
+		goto slot_status;
+	}
+#endif
 
 	/* if DEBUG_LEVEL_PERIODIC is not set we remove DEBUG_LEVEL_COMM */
 	oldLogLevel = LogLevel;
 	if (! (LogLevel & DEBUG_LEVEL_PERIODIC))
 		LogLevel &= ~DEBUG_LEVEL_COMM;
 
-	return_value = CmdGetSlotStatus(ccid_reader, pcbuffer);
-
-	/* set back the old timeout */
-	ccid_descriptor->readTimeout = oldReadTimeout;
+	/* use default timeout since the reader may not be present anymore */
+	return_value = CmdGetSlotStatus(ccid_reader, pcbuffer,
+		DEFAULT_COM_READ_TIMEOUT);
 
 	/* set back the old LogLevel */
 	LogLevel = oldLogLevel;
@@ -2182,6 +2359,7 @@ EXTERNAL RESPONSECODE IFDHICCPresence(DWORD Lun)
 				 * removed and inserted between two consecutive
 				 * IFDHICCPresence() calls */
 				ccid_reader->bPowerFlags = POWERFLAGS_RAZ;
+				ccid_reader->learnedVoltage = VOLTAGE_AUTO;
 				return_value = IFD_ICC_NOT_PRESENT;
 			}
 			break;
@@ -2194,10 +2372,21 @@ EXTERNAL RESPONSECODE IFDHICCPresence(DWORD Lun)
 			/* Reset PowerFlags */
 			ccid_reader->bPowerFlags = POWERFLAGS_RAZ;
 
+			/* the next card may not accept the same voltage */
+			ccid_reader->learnedVoltage = VOLTAGE_AUTO;
+
 			return_value = IFD_ICC_NOT_PRESENT;
 			break;
 	}
 
+#ifndef TWIN_SERIAL
+	/* the next card movements will be notified by the interrupt endpoint */
+	if (return_value != IFD_COMMUNICATION_ERROR)
+		InterruptSetPresence(ccid_reader, presence_events,
+			(CCID_ICC_ABSENT == (pcbuffer[7] & CCID_ICC_STATUS_MASK)) ?
+			IFD_ICC_NOT_PRESENT : IFD_ICC_PRESENT);
+#endif
+
 #if 0
 	/* SCR331-DI contactless reader */
 	if (((SCR331DI == ccid_descriptor->readerID)
@@ -2247,6 +2436,9 @@ EXTERNAL RESPONSECODE IFDHICCPresence(DWORD Lun)
 	}
 #endif
 
+#ifndef TWIN_SERIAL
+slot_status:
+#endif
 #ifdef SEC1210_SYNC
 	if (SEC1210 == ccid_descriptor->readerID)
 	{
@@ -2273,28 +2465,33 @@ end:
 
 void init_driver(void)
 {
-	char infofile[FILENAME_MAX];
 	char *e;
 	int rv;
-	list_t plist, *values;
-	const char * hpDirPath;
+	list_t *plist, *values;
+#ifdef USE_COMPILED_READER_DB
+	/* the supported readers are compiled in the driver */
+	static const char * const keys[] = { "ifdLogLevel", "ifdDriverOptions",
+		NULL };
+	list_t keys_plist;
+#else
+	struct bundleCache *bundle;
+#endif
 
 	DEBUG_INFO1("Driver version: " VERSION);
 
-	/* Check if path override present in environment */
-	hpDirPath = SYS_GetEnv("PCSCLITE_HP_DROPDIR");
-	if (NULL == hpDirPath)
-		hpDirPath = PCSCLITE_HP_DROPDIR;
-
-	/* Info.plist full patch filename */
-	(void)snprintf(infofile, sizeof(infofile), "%s/%s/Contents/Info.plist",
-		hpDirPath, BUNDLE);
-
-	rv = bundleParse(infofile, &plist);
-	if (0 == rv)
+#ifdef USE_COMPILED_READER_DB
+	/* only the driver options are read and nothing is kept */
+	plist = BundleParseKeys(&keys_plist, keys) ? NULL : &keys_plist;
+#else
+	/* the parsed Info.plist is kept for OpenUSBByName() */
+	bundle = BundleCacheGet();
+	plist = bundle ? &bundle->plist : NULL;
+#endif
+	if (plist)
 	{
+
 		/* Log level */
-		rv = LTPBundleFindValueWithKey(&plist, "ifdLogLevel", &values);
+		rv = LTPBundleFindValueWithKey(plist, "ifdLogLevel", &values);
 		if (0 == rv)
 		{
 			/* convert from hex or dec or octal */
@@ -2305,7 +2502,7 @@ void init_driver(void)
 		}
 
 		/* Driver options */
-		rv = LTPBundleFindValueWithKey(&plist, "ifdDriverOptions", &values);
+		rv = LTPBundleFindValueWithKey(plist, "ifdDriverOptions", &values);
 		if (0 == rv)
 		{
 			/* convert from hex or dec or octal */
@@ -2315,7 +2512,11 @@ void init_driver(void)
 			DEBUG_INFO2("DriverOptions: 0x%.4X", DriverOptions);
 		}
 
-		bundleRelease(&plist);
+#ifdef USE_COMPILED_READER_DB
+		bundleRelease(plist);
+#else
+		BundleCacheRelease(bundle);
+#endif
 	}
 
 	e = getenv("LIBCCID_ifdLogLevel");
@@ -2518,3 +2719,340 @@ static int get_IFSC(ATR_t *atr, int *idx)
 	return ifsc;
 } /* get_IFSC */
 
+
+/*****************************************************************************
+ *
+ *					run_apdu_script
+ *
+ ****************************************************************************/
+static RESPONSECODE run_apdu_script(CcidDesc * ccid_reader,
+	PUCHAR TxBuffer, DWORD TxLength, PUCHAR RxBuffer, DWORD RxLength,
+	PDWORD pdwBytesReturned)
+{
+	/*
+	 * Execute a list of APDUs in one call.
+	 *
+	 * TxBuffer contains TLV records: tag (1 byte), length (2 bytes, big
+	 * endian), value.
+	 * APDU_SCRIPT_TAG_COMMAND: the APDU to send to the card
+	 * APDU_SCRIPT_TAG_EXPECTED_STATUS (optional, after a command):
+	 *	SW1 SW2 mask1 mask2. The script stops if the status word of the
+	 *	response does not match.
+	 *
+	 * RxBuffer receives one APDU_SCRIPT_TAG_RESPONSE record per executed
+	 * APDU. If the last response did not have the expected status word
+	 * the number of responses is lower than the number of commands.
+	 */
+	_ccid_descriptor *ccid_descriptor = &ccid_reader->device.ccid;
+	int protocol;
+	DWORD tx = 0, rx = 0;
+	int nb_apdu = 0;
+
+	protocol = (SCARD_PROTOCOL_T1 == ccid_descriptor->cardProtocol) ? T_1 : T_0;
+
+	while (tx < TxLength)
+	{
+		PUCHAR apdu;
+		unsigned int apdu_length, rx_length;
+		PUCHAR expected = NULL;
+		RESPONSECODE return_value;
+
+		/* command record */
+		if ((TxLength - tx < 3) || (TxBuffer[tx] != APDU_SCRIPT_TAG_COMMAND))
+		{
+			DEBUG_CRITICAL2("Command expected at offset %ld", (long)tx);
+			return IFD_COMMUNICATION_ERROR;
+		}
+		apdu_length = (TxBuffer[tx+1] << 8) + TxBuffer[tx+2];
+		apdu = TxBuffer + tx + 3;
+		tx += 3;
+		if (TxLength - tx < apdu_length)
+		{
+			DEBUG_CRITICAL2("Truncated command at offset %ld", (long)tx);
+			return IFD_COMMUNICATION_ERROR;
+		}
+		tx += apdu_length;
+
+		/* optional expected status record */
+		if ((tx < TxLength) && (APDU_SCRIPT_TAG_EXPECTED_STATUS == TxBuffer[tx]))
+		{
+			if ((TxLength - tx < 3 + 4) || (TxBuffer[tx+1] != 0)
+				|| (TxBuffer[tx+2] != 4))
+			{
+				DEBUG_CRITICAL2("Wrong expected status at offset %ld",
+					(long)tx);
+				return IFD_COMMUNICATION_ERROR;
+			}
+			expected = TxBuffer + tx + 3;
+			tx += 3 + 4;
+		}
+
+		/* room for the response record header */
+		if (RxLength - rx < 3)
+			return IFD_ERROR_INSUFFICIENT_BUFFER;
+
+		/* the response is received directly in its record */
+		rx_length = RxLength - rx - 3;
+		if (rx_length > 0xFFFF)
+			rx_length = 0xFFFF;
+		return_value = CmdXfrBlock(ccid_reader, apdu_length, apdu,
+			&rx_length, RxBuffer + rx + 3, protocol,
+			ccid_descriptor->readTimeout);
+		if (return_value != IFD_SUCCESS)
+			return return_value;
+
+		RxBuffer[rx] = APDU_SCRIPT_TAG_RESPONSE;
+		RxBuffer[rx+1] = rx_length >> 8;
+		RxBuffer[rx+2] = rx_length;
+		rx += 3 + rx_length;
+		*pdwBytesReturned = rx;
+		nb_apdu++;
+
+		if (expected)
+		{
+			PUCHAR sw = RxBuffer + rx - 2;
+
+			if ((rx_length < 2)
+				|| ((sw[0] & expected[2]) != (expected[0] & expected[2]))
+				|| ((sw[1] & expected[3]) != (expected[1] & expected[3])))
+			{
+				DEBUG_INFO2("Unexpected status word for APDU %d", nb_apdu);
+				break;
+			}
+		}
+	}
+
+	DEBUG_INFO2("%d APDU executed", nb_apdu);
+
+	return IFD_SUCCESS;
+} /* run_apdu_script */
+
+
+/*****************************************************************************
+ *
+ *					learn_voltage
+ *
+ ****************************************************************************/
+static void learn_voltage(CcidDesc * ccid_reader, int voltage)
+{
+#ifndef NO_LOG
+	const char *voltage_code[] = { "auto", "5V", "3V", "1.8V" };
+#endif
+
+	/* voltage selected by the reader */
+	if (VOLTAGE_AUTO == voltage)
+		return;
+
+	if (voltage == ccid_reader->learnedVoltage)
+		return;
+
+	DEBUG_INFO2("Learned power up voltage: %s", voltage_code[voltage]);
+	ccid_reader->learnedVoltage = voltage;
+} /* learn_voltage */
+
+
+/*****************************************************************************
+ *
+ *					set_max_clock_and_data_rate
+ *
+ ****************************************************************************/
+static void set_max_clock_and_data_rate(CcidDesc * ccid_reader,
+	ATR_t *atr, BYTE fidi)
+{
+	_ccid_descriptor *ccid_desc = &ccid_reader->device.ccid;
+	unsigned int default_clocks[3];
+	unsigned int *clocks;
+	unsigned int clock = 0, data_rate = 0;
+	unsigned int max_clock;
+	double f, d, fmax, negotiated_fmax;
+	ATR_t negotiated;
+	RESPONSECODE ret;
+	int i;
+
+	/* f(max) of the card from its ATR */
+	(void)ATR_GetParameter(atr, ATR_PARAMETER_FMAX, &fmax);
+
+	/* F, D and f(max) really used after the PPS */
+	negotiated = *atr;
+	negotiated.ib[0][ATR_INTERFACE_BYTE_TA].present = true;
+	negotiated.ib[0][ATR_INTERFACE_BYTE_TA].value = fidi;
+	(void)ATR_GetParameter(&negotiated, ATR_PARAMETER_F, &f);
+	(void)ATR_GetParameter(&negotiated, ATR_PARAMETER_D, &d);
+	(void)ATR_GetParameter(&negotiated, ATR_PARAMETER_FMAX,
+		&negotiated_fmax);
+
+	/* may happen with non ISO cards */
+	if ((0 == f) || (0 == d) || (0 == fmax) || (0 == negotiated_fmax))
+		return;
+
+	max_clock = (fmax < negotiated_fmax) ? fmax : negotiated_fmax;
+	if ((ccid_desc->dwMaximumClock > 0)
+		&& ((unsigned int)ccid_desc->dwMaximumClock < max_clock))
+		max_clock = ccid_desc->dwMaximumClock;
+
+	/* the reader has no clock frequencies table: default and maximum
+	 * clocks only */
+	clocks = ccid_desc->arrayOfSupportedClocks;
+	if (NULL == clocks)
+	{
+		default_clocks[0] = ccid_desc->dwDefaultClock;
+		default_clocks[1] = ccid_desc->dwMaximumClock;
+		default_clocks[2] = 0;
+		clocks = default_clocks;
+	}
+
+	for (i=0; clocks[i]; i++)
+	{
+		unsigned int card_baudrate;
+
+		if ((clocks[i] > max_clock) || (clocks[i] <= clock))
+			continue;
+
+		/* Baudrate = f x D/F */
+		card_baudrate = (unsigned int) (1000 * clocks[i] * d / f);
+
+		/* the reader has a baud rate table */
+		if ((ccid_desc->arrayOfSupportedDataRates
+			/* and the baud rate is supported */
+			&& find_baud_rate(card_baudrate,
+			ccid_desc->arrayOfSupportedDataRates))
+			/* or the reader has NO baud rate table */
+			|| ((NULL == ccid_desc->arrayOfSupportedDataRates)
+			/* and the baud rate is below the limit */
+			&& (card_baudrate <= ccid_desc->dwMaxDataRate)))
+		{
+			clock = clocks[i];
+			data_rate = card_baudrate;
+		}
+	}
+
+	/* nothing better than the default clock */
+	if (clock <= (unsigned int)ccid_desc->dwDefaultClock)
+	{
+		DEBUG_COMM2("Keep the default clock of %d kHz",
+			ccid_desc->dwDefaultClock);
+		return;
+	}
+
+	DEBUG_COMM3("Set clock to %d kHz and speed to %d bauds", clock,
+		data_rate);
+	ret = SetDataRateAndClockFrequency(ccid_reader, &clock, &data_rate);
+	if (IFD_SUCCESS != ret)
+	{
+		/* the reader may refuse this clock or data rate. This is only
+		 * an optimisation: continue at the default clock */
+		DEBUG_INFO2("SetDataRateAndClockFrequency failed: " DWORD_D
+			". Keep the default clock", ret);
+		return;
+	}
+
+	ccid_reader->negotiated.clock = clock;
+	ccid_reader->negotiated.data_rate = data_rate;
+} /* set_max_clock_and_data_rate */
+
+
+/*****************************************************************************
+ *
+ *					replay_negotiation
+ *
+ ****************************************************************************/
+static RESPONSECODE replay_negotiation(CcidDesc * ccid_reader)
+{
+	_ccid_descriptor *ccid_desc = &ccid_reader->device.ccid;
+	t1_state_t *t1 = &(ccid_reader -> t1);
+	BYTE param[sizeof ccid_reader->negotiated.abProtocolDataStructure];
+	BYTE pps[PPS_MAX_LENGTH];
+	unsigned int len;
+	RESPONSECODE ret;
+
+	ccid_desc->readTimeout = ccid_reader->negotiated.readTimeout;
+	ccid_desc->cardProtocol = ccid_reader->negotiated.protocol;
+
+	/* the card and the reader still use these parameters */
+	if (ccid_reader->negotiated.applied)
+	{
+		DEBUG_COMM("Parameters already negotiated");
+		return IFD_SUCCESS;
+	}
+
+	DEBUG_COMM("Replay the previous negotiation");
+
+	memcpy(param, ccid_reader->negotiated.abProtocolDataStructure,
+		ccid_reader->negotiated.dwLength);
+
+	if (ccid_reader->negotiated.pps_sent)
+	{
+		memcpy(pps, ccid_reader->negotiated.pps, sizeof pps);
+		if (PPS_Exchange(ccid_reader, pps, &len, &pps[2]) != PPS_OK)
+		{
+			DEBUG_INFO1("PPS_Exchange Failed");
+			ccid_reader->negotiated.valid = false;
+
+			return IFD_ERROR_PTS_FAILURE;
+		}
+
+		/* TA1 confirmed by the card */
+		param[0] = PPS_HAS_PPS1(pps) ? pps[2] : 0x11;
+	}
+
+	if (ccid_desc->dwFeatures & CCID_CLASS_AUTO_PPS_PROP)
+		DEBUG_COMM("Skip SetParameters");
+	else
+	{
+		ret = SetParameters(ccid_reader,
+			(SCARD_PROTOCOL_T1 == ccid_reader->negotiated.protocol) ? 1 : 0,
+			ccid_reader->negotiated.dwLength, param);
+		if (IFD_SUCCESS != ret)
+		{
+			ccid_reader->negotiated.valid = false;
+			return ret;
+		}
+	}
+
+	if (ccid_reader->negotiated.clock)
+	{
+		unsigned int clock = ccid_reader->negotiated.clock;
+		unsigned int data_rate = ccid_reader->negotiated.data_rate;
+
+		ret = SetDataRateAndClockFrequency(ccid_reader, &clock, &data_rate);
+		if (IFD_SUCCESS != ret)
+		{
+			/* continue at the default clock */
+			DEBUG_INFO2("SetDataRateAndClockFrequency failed: " DWORD_D
+				". Keep the default clock", ret);
+			ccid_reader->negotiated.clock = 0;
+			ccid_reader->negotiated.data_rate = 0;
+		}
+	}
+
+	/* set IFSC & IFSD in T=1 */
+	if (SCARD_PROTOCOL_T1 == ccid_reader->negotiated.protocol)
+	{
+		(void)t1_set_param(t1, ccid_reader->negotiated.t1_checksum, 0);
+
+		if (CCID_CLASS_TPDU == (ccid_desc->dwFeatures & CCID_CLASS_EXCHANGE_MASK))
+		{
+			(void)t1_set_param(t1, IFD_PROTOCOL_T1_IFSC,
+				ccid_reader->negotiated.ifsc);
+
+			/* IFSD not negotiated by the reader? */
+			if (! (ccid_desc->dwFeatures & CCID_CLASS_AUTO_IFSD))
+			{
+				DEBUG_COMM2("Negotiate IFSD at %d", ccid_desc -> dwMaxIFSD);
+				if (t1_negotiate_ifsd(t1, 0, ccid_desc -> dwMaxIFSD,
+					ccid_desc -> readTimeout) < 0)
+				{
+					ccid_reader->negotiated.valid = false;
+					return IFD_COMMUNICATION_ERROR;
+				}
+			}
+			(void)t1_set_param(t1, IFD_PROTOCOL_T1_IFSD, ccid_desc -> dwMaxIFSD);
+
+			DEBUG_COMM3("T=1: IFSC=%d, IFSD=%d", t1->ifsc, t1->ifsd);
+		}
+	}
+
+	ccid_reader->negotiated.applied = true;
+
+	return IFD_SUCCESS;
+} /* replay_negotiation */
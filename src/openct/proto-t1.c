@@ -59,7 +59,8 @@ static unsigned int t1_seq(unsigned char);
 static unsigned int t1_rebuild(t1_state_t *t1, unsigned char *block);
 static unsigned int t1_compute_checksum(t1_state_t *, unsigned char *, size_t);
 static int t1_verify_checksum(t1_state_t *, unsigned char *, size_t);
-static int t1_xcv(t1_state_t *, unsigned char *, size_t, size_t);
+static int t1_xcv(t1_state_t *, unsigned char *, size_t, size_t,
+	unsigned int);
 
 /*
  * Set default T=1 protocol parameters
@@ -106,6 +107,19 @@ int t1_init(t1_state_t * t1, struct CCID_DESC * ccid_reader)
 	return 0;
 }
 
+/*
+ * Restart the block sequence after a reset of the card. The parameters
+ * (IFSC, IFSD, checksum, NAD) are kept
+ */
+void t1_restart(t1_state_t * t1)
+{
+	t1->nr = 0;
+	t1->ns = 0;
+	t1->wtx = 0;
+	t1_set_param(t1, IFD_PROTOCOL_T1_STATE, SENDING);
+	t1_set_param(t1, IFD_PROTOCOL_T1_MORE, false);
+}
+
 /*
  * Detach t1 protocol
  */
@@ -173,10 +187,12 @@ int t1_get_param(t1_state_t * t1, int type)
  */
 int t1_transceive(t1_state_t * t1, unsigned int dad,
 		const void *snd_buf, size_t snd_len,
-		void *rcv_buf, size_t rcv_len)
+		void *rcv_buf, size_t rcv_len, unsigned int timeout)
 {
 	ct_buf_t sbuf, rbuf, tbuf;
-	unsigned char sdata[T1_BUFFER_SIZE], sblk[5];
+	/* room for the CCID header before the block, see t1_xcv() */
+	unsigned char frame[CCID_HEADER_SIZE + T1_BUFFER_SIZE], sblk[5];
+	unsigned char *sdata = frame + CCID_HEADER_SIZE;
 	unsigned int slen, resyncs;
 	int retries;
 	size_t last_send = 0;
@@ -208,7 +224,7 @@ int t1_transceive(t1_state_t * t1, unsigned int dad,
 
 		retries--;
 
-		n = t1_xcv(t1, sdata, slen, sizeof(sdata));
+		n = t1_xcv(t1, sdata, slen, T1_BUFFER_SIZE, timeout);
 		if (-2 == n)
 		{
 			DEBUG_COMM("Parity error");
@@ -665,33 +681,29 @@ static int t1_verify_checksum(t1_state_t * t1, unsigned char *rbuf,
 
 /*
  * Send/receive block
+ * CCID_HEADER_SIZE bytes must be available before block
  */
 static int t1_xcv(t1_state_t * t1, unsigned char *block, size_t slen,
-	size_t rmax)
+	size_t rmax, unsigned int timeout)
 {
 	int n;
 	struct CCID_DESC * ccid_reader = t1->ccid_reader;
-	int oldReadTimeout;
 	unsigned int rmax_int;
 
 	DEBUG_XXD("sending: ", block, slen);
 
-	oldReadTimeout = set_read_timeout(ccid_reader, -1);
-
 	if (t1->wtx > 1)
 	{
-		/* set the new temporary timeout at WTX card request */
-		int newReadTimeout =  oldReadTimeout * t1->wtx;
-		set_read_timeout(ccid_reader, newReadTimeout);
-		DEBUG_INFO2("New timeout at WTX request: %d sec",
-			newReadTimeout);
+		/* use a longer timeout for this block at WTX card request */
+		timeout *= t1->wtx;
+		DEBUG_INFO2("New timeout at WTX request: %d ms", timeout);
 	}
 
 	if (isCharLevel(ccid_reader))
 	{
 		rmax = 3;
 
-		n = CCID_Transmit(ccid_reader, slen, block, rmax, t1->wtx);
+		n = CCID_TransmitInPlace(ccid_reader, slen, block, rmax, t1->wtx);
 		if (n != IFD_SUCCESS)
 			return -1;
 
@@ -699,7 +711,7 @@ static int t1_xcv(t1_state_t * t1, unsigned char *block, size_t slen,
 		 * so we can't use &rmax since &rmax is a (size_t *) and may not
 		 * be the same on 64-bits architectures for example (iMac G5) */
 		rmax_int = rmax;
-		n = CCID_Receive(ccid_reader, &rmax_int, block, NULL);
+		n = CCID_ReceiveInPlace(ccid_reader, &rmax_int, block, timeout);
 
 		if (n == IFD_PARITY_ERROR)
 			return -2;
@@ -713,7 +725,7 @@ static int t1_xcv(t1_state_t * t1, unsigned char *block, size_t slen,
 			return -1;
 
 		rmax_int = rmax;
-		n = CCID_Receive(ccid_reader, &rmax_int, &block[3], NULL);
+		n = CCID_Receive(ccid_reader, &rmax_int, &block[3], NULL, timeout);
 		rmax = rmax_int;
 		if (n == IFD_PARITY_ERROR)
 			return -2;
@@ -724,14 +736,14 @@ static int t1_xcv(t1_state_t * t1, unsigned char *block, size_t slen,
 	}
 	else
 	{
-		n = CCID_Transmit(ccid_reader, slen, block, 0, t1->wtx);
+		n = CCID_TransmitInPlace(ccid_reader, slen, block, 0, t1->wtx);
 		t1->wtx = 0;	/* reset to default value */
 		if (n != IFD_SUCCESS)
 			return -1;
 
 		/* Get the response en block */
 		rmax_int = rmax;
-		n = CCID_Receive(ccid_reader, &rmax_int, block, NULL);
+		n = CCID_ReceiveInPlace(ccid_reader, &rmax_int, block, timeout);
 		rmax = rmax_int;
 		if (n == IFD_PARITY_ERROR)
 			return -2;
@@ -753,16 +765,15 @@ static int t1_xcv(t1_state_t * t1, unsigned char *block, size_t slen,
 	if (n >= 0)
 		DEBUG_XXD("received: ", block, n);
 
-	/* Restore initial timeout */
-	set_read_timeout(ccid_reader, oldReadTimeout);
-
 	return n;
 }
 
-int t1_negotiate_ifsd(t1_state_t * t1, unsigned int dad, int ifsd)
+int t1_negotiate_ifsd(t1_state_t * t1, unsigned int dad, int ifsd,
+	unsigned int timeout)
 {
 	ct_buf_t sbuf;
-	unsigned char sdata[T1_BUFFER_SIZE];
+	unsigned char frame[CCID_HEADER_SIZE + T1_BUFFER_SIZE];
+	unsigned char *sdata = frame + CCID_HEADER_SIZE;
 	unsigned int slen;
 	int retries;
 	size_t snd_len;
@@ -789,7 +800,7 @@ int t1_negotiate_ifsd(t1_state_t * t1, unsigned int dad, int ifsd)
 			goto error;
 
 		/* Send the block */
-		n = t1_xcv(t1, sdata, slen, sizeof(sdata));
+		n = t1_xcv(t1, sdata, slen, T1_BUFFER_SIZE, timeout);
 
 		if (-1 == n)
 		{
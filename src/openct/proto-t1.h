@@ -73,12 +73,14 @@ typedef struct {
 
 int t1_transceive(t1_state_t *t1, unsigned int dad,
 		const void *snd_buf, size_t snd_len,
-		void *rcv_buf, size_t rcv_len);
+		void *rcv_buf, size_t rcv_len, unsigned int timeout);
 int t1_init(t1_state_t *t1, struct CCID_DESC * ccid_reader);
+void t1_restart(t1_state_t *t1);
 void t1_release(t1_state_t *t1);
 int t1_set_param(t1_state_t *t1, int type, long value);
 int t1_get_param(t1_state_t *t1, int type);
-int t1_negotiate_ifsd(t1_state_t *t1, unsigned int dad, int ifsd);
+int t1_negotiate_ifsd(t1_state_t *t1, unsigned int dad, int ifsd,
+	unsigned int timeout);
 unsigned int t1_build(t1_state_t *, unsigned char *,
 	unsigned char, unsigned char, ct_buf_t *, size_t *);
 
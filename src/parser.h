@@ -48,6 +48,8 @@ struct bundleElt
 
 int LTPBundleFindValueWithKey(list_t *l, const char *key, list_t **values);
 int bundleParse(const char *fileName, list_t *l);
+int bundleParseKeys(const char *fileName, list_t *l,
+	const char * const keys[]);
 void bundleRelease(list_t *l);
 
 #endif
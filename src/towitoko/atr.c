@@ -48,6 +48,12 @@ atr_f_table[16] =
   372, 372, 558, 744, 1116, 1488, 1860, 0, 0, 512, 768, 1024, 1536, 2048, 0, 0
 };
 
+static unsigned
+atr_fmax_table[16] =
+{
+  4000, 5000, 6000, 8000, 12000, 16000, 20000, 0, 0, 5000, 7500, 10000, 15000, 20000, 0, 0
+};
+
 static unsigned
 atr_d_table[16] =
 {
@@ -269,6 +275,15 @@ ATR_GetParameter (ATR_t * atr, int name, double *parameter)
       return (ATR_OK);
     }
 
+  else if (name == ATR_PARAMETER_FMAX)
+    {
+      if (ATR_GetIntegerValue (atr, ATR_INTEGER_VALUE_FI, &FI) == ATR_OK)
+	(*parameter) = (double) (atr_fmax_table[FI]);
+      else
+	(*parameter) = (double) ATR_DEFAULT_FMAX;
+      return (ATR_OK);
+    }
+
   else if (name == ATR_PARAMETER_D)
     {
       if (ATR_GetIntegerValue (atr, ATR_INTEGER_VALUE_DI, &DI) == ATR_OK)
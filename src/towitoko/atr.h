@@ -56,6 +56,7 @@
 #define ATR_PARAMETER_I		2	/* Parameter I */
 #define ATR_PARAMETER_P		3	/* Parameter P */
 #define ATR_PARAMETER_N		4	/* Parameter N */
+#define ATR_PARAMETER_FMAX	5	/* Parameter f(max) in kHz */
 #define ATR_INTEGER_VALUE_FI	0	/* Integer value FI */
 #define ATR_INTEGER_VALUE_DI	1	/* Integer value DI */
 #define ATR_INTEGER_VALUE_II	2	/* Integer value II */
@@ -69,6 +70,7 @@
 #define ATR_DEFAULT_I	50
 #define ATR_DEFAULT_N	0
 #define ATR_DEFAULT_P	5
+#define ATR_DEFAULT_FMAX	5000
 
 /*
  * Exported data types definition
@@ -61,7 +61,8 @@ PPS_Exchange (CcidDesc * ccid_reader, BYTE * params, unsigned *length, unsigned
 
   /* Get PPS confirm */
   len_confirm = sizeof(confirm);
-  if (CCID_Receive (ccid_reader, &len_confirm, confirm, NULL) != IFD_SUCCESS)
+  if (CCID_Receive (ccid_reader, &len_confirm, confirm, NULL,
+      ccid_reader->device.ccid.readTimeout) != IFD_SUCCESS)
     return PPS_ICC_ERROR;
 
   DEBUG_XXD ("PPS: Receiving confirm: ", confirm, len_confirm);
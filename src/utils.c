@@ -17,8 +17,12 @@
 	Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <pcsclite.h>
 
 #include <config.h>
@@ -27,6 +31,8 @@
 #include "ccid_ifdhandler.h"
 #include "utils.h"
 #include "debug.h"
+#include "sys_generic.h"
+#include "strlcpycat.h"
 
 #define FREE_ENTRY -42
 
@@ -181,3 +187,152 @@ void p_bswap_32(void *ptr)
 	array[1] = array[2];
 	array[2] = tmp;
 }
+
+/* Info.plist is parsed only once, unless the file is modified */
+static pthread_mutex_t bundle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct bundleCache *bundle_cache = NULL;
+static unsigned int bundle_generation = 0;
+
+/* must be called with bundle_mutex locked */
+static void bundle_unref(struct bundleCache *bundle)
+{
+	bundle->refcount--;
+	if (0 == bundle->refcount)
+	{
+		bundleRelease(&bundle->plist);
+		free(bundle);
+	}
+} /* bundle_unref */
+
+static void get_infofile(char *infofile, size_t size)
+{
+	const char *hpDirPath;
+
+	/* Check if path override present in environment */
+	hpDirPath = SYS_GetEnv("PCSCLITE_HP_DROPDIR");
+	if (NULL == hpDirPath)
+		hpDirPath = PCSCLITE_HP_DROPDIR;
+
+	/* Info.plist full patch filename */
+	(void)snprintf(infofile, size, "%s/%s/Contents/Info.plist",
+		hpDirPath, BUNDLE);
+} /* get_infofile */
+
+struct bundleCache *BundleCacheGet(void)
+{
+	char infofile[FILENAME_MAX];
+	struct stat sb;
+	struct bundleCache *bundle = NULL;
+
+	get_infofile(infofile, sizeof(infofile));
+
+	if (stat(infofile, &sb) < 0)
+	{
+		DEBUG_CRITICAL3("Could not open bundle file %s: %s", infofile,
+			strerror(errno));
+		return NULL;
+	}
+
+	pthread_mutex_lock(&bundle_mutex);
+
+	/* the cached version is still valid? */
+	if (bundle_cache
+		&& (0 == strcmp(bundle_cache->infofile, infofile))
+		&& (bundle_cache->mtime == sb.st_mtime)
+		&& (bundle_cache->size == sb.st_size))
+	{
+		bundle = bundle_cache;
+		bundle->refcount++;
+		goto end;
+	}
+
+	DEBUG_INFO2("Using: " LOG_STRING, infofile);
+
+	bundle = calloc(1, sizeof(*bundle));
+	if (NULL == bundle)
+	{
+		DEBUG_CRITICAL("No memory");
+		goto end;
+	}
+
+	if (bundleParse(infofile, &bundle->plist))
+	{
+		free(bundle);
+		bundle = NULL;
+		goto end;
+	}
+
+	(void)strlcpy(bundle->infofile, infofile, sizeof(bundle->infofile));
+	bundle->mtime = sb.st_mtime;
+	bundle->size = sb.st_size;
+	bundle->generation = ++bundle_generation;
+
+	/* one reference for the cache and one for the caller */
+	bundle->refcount = 2;
+
+	/* replace the previous version */
+	if (bundle_cache)
+		bundle_unref(bundle_cache);
+	bundle_cache = bundle;
+
+end:
+	pthread_mutex_unlock(&bundle_mutex);
+
+	return bundle;
+} /* BundleCacheGet */
+
+void BundleCacheRelease(struct bundleCache *bundle)
+{
+	pthread_mutex_lock(&bundle_mutex);
+	bundle_unref(bundle);
+	pthread_mutex_unlock(&bundle_mutex);
+} /* BundleCacheRelease */
+
+/* parse only some keys of Info.plist, without caching the result.
+ * The list must be freed using bundleRelease() */
+int BundleParseKeys(list_t *plist, const char * const keys[])
+{
+	char infofile[FILENAME_MAX];
+
+	get_infofile(infofile, sizeof(infofile));
+	DEBUG_INFO2("Using: " LOG_STRING, infofile);
+
+	return bundleParseKeys(infofile, plist, keys);
+} /* BundleParseKeys */
+
+__attribute__ ((destructor)) static void FiniBundleCache(void)
+{
+	if (bundle_cache)
+		bundle_unref(bundle_cache);
+	bundle_cache = NULL;
+} /* FiniBundleCache */
+
+void deadline_init(struct timespec *deadline, unsigned int timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline_extend(deadline, timeout);
+} /* deadline_init */
+
+void deadline_extend(struct timespec *deadline, unsigned int timeout)
+{
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (timeout % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L)
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+} /* deadline_extend */
+
+/* remaining time in ms, 0 if the deadline is reached */
+unsigned int deadline_remaining(const struct timespec *deadline)
+{
+	struct timespec now;
+	long long remaining;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining = (deadline->tv_sec - now.tv_sec) * 1000LL
+		+ (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+
+	return remaining > 0 ? remaining : 0;
+} /* deadline_remaining */
@@ -28,3 +28,33 @@ void set_U16(void *, uint16_t);
 void set_U32(void *, uint32_t);
 void p_bswap_16(void *ptr);
 void p_bswap_32(void *ptr);
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include "parser.h"
+
+/* parsed Info.plist shared by all the readers */
+struct bundleCache
+{
+	list_t plist;
+	char infofile[FILENAME_MAX];
+
+	/* to detect a modified file */
+	time_t mtime;
+	off_t size;
+
+	/* incremented each time the file is parsed again */
+	unsigned int generation;
+
+	int refcount;
+};
+
+struct bundleCache *BundleCacheGet(void);
+void BundleCacheRelease(struct bundleCache *bundle);
+int BundleParseKeys(list_t *plist, const char * const keys[]);
+
+/* absolute CLOCK_MONOTONIC deadlines, timeouts in ms */
+void deadline_init(struct timespec *deadline, unsigned int timeout);
+void deadline_extend(struct timespec *deadline, unsigned int timeout);
+unsigned int deadline_remaining(const struct timespec *deadline);